@@ -0,0 +1,596 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include "aead.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Ciphertexts from here on are opened fused, in chunks of AEAD_CHUNK_LEN,
+// which must be a multiple of 64.
+#ifndef AEAD_FUSED_MIN_LEN
+#define AEAD_FUSED_MIN_LEN (64*1024)
+#endif
+#ifndef AEAD_CHUNK_LEN
+#define AEAD_CHUNK_LEN (16*1024)
+#endif
+
+// Records up to TLS_SHORT_LEN bytes go through the lanes kernel, up to
+// TLS_BATCH_RECORDS at a time.
+#ifndef TLS_SHORT_LEN
+#define TLS_SHORT_LEN 256
+#endif
+#ifndef TLS_BATCH_RECORDS
+#define TLS_BATCH_RECORDS 32
+#endif
+
+// SSH length keystreams are computed up to SSH_LENGTH_LANES at a time.
+#ifndef SSH_LENGTH_LANES
+#define SSH_LENGTH_LANES 64
+#endif
+
+#ifdef __riscv_zvkb
+#define chacha20 vector_chacha20_zvkb
+#define chacha20_lanes vector_chacha20_zvkb_lanes
+#define chacha20_hp_masks vector_chacha20_zvkb_hp_masks
+#define chacha20_keyed_lanes vector_chacha20_zvkb_keyed_lanes
+#else
+#define chacha20 vector_chacha20
+#define chacha20_lanes vector_chacha20_lanes
+#define chacha20_hp_masks vector_chacha20_hp_masks
+#define chacha20_keyed_lanes vector_chacha20_keyed_lanes
+#endif
+
+extern void chacha20(uint8_t *out, const uint8_t *in, size_t in_len,
+		     const uint8_t key[32], const uint8_t nonce[12],
+		     uint32_t counter);
+extern void chacha20_lanes(uint8_t *out, size_t blocks, const uint8_t key[32],
+			   const uint32_t counter_nonce[][4]);
+extern void chacha20_hp_masks(uint8_t masks[][5], size_t blocks,
+			      const uint8_t key[32],
+			      const uint8_t samples[][16]);
+extern void chacha20_keyed_lanes(uint8_t *out, size_t blocks,
+				 const uint32_t key_counter_nonce[][12]);
+
+extern void vector_xor(uint8_t *out, const uint8_t *in,
+		       const uint8_t *keystream, size_t len);
+
+extern void vector_poly1305_init(void *ctx, const unsigned char key[16]);
+extern void vector_poly1305_blocks(void *ctx, const unsigned char *inp,
+				   size_t len, uint32_t padbit);
+extern void vector_poly1305_emit(void *ctx, unsigned char mac[16],
+				 const uint8_t nonce[16]);
+
+// ChaCha20 of any length, finishing a partial block through a buffer.
+static void chacha20_xor(uint8_t *out, const uint8_t *in, size_t len,
+			 const uint8_t key[32], const uint8_t nonce[12],
+			 uint32_t counter) {
+  size_t block_len = len & ~63;
+  chacha20(out, in, block_len, key, nonce, counter);
+  if (len > block_len) {
+    uint8_t buffer[64];
+    memset(buffer, 0, 64);
+    memcpy(buffer, in + block_len, len - block_len);
+    chacha20(buffer, buffer, 64, key, nonce, counter + block_len / 64);
+    memcpy(out + block_len, buffer, len - block_len);
+  }
+}
+
+void vector_chacha20_at(uint8_t *out, const uint8_t *in, size_t len,
+			const uint8_t key[32], const uint8_t nonce[12],
+			uint64_t offset) {
+  uint32_t counter = offset / 64;
+  size_t skip = offset % 64;
+  if (skip > 0 && len > 0) {
+    uint8_t block[64];
+    memset(block, 0, 64);
+    chacha20(block, block, 64, key, nonce, counter);
+    size_t head_len = len < 64 - skip ? len : 64 - skip;
+    for (size_t i = 0; i < head_len; i++) {
+      out[i] = in[i] ^ block[skip + i];
+    }
+    memset(block, 0, 64);
+    out += head_len;
+    in += head_len;
+    len -= head_len;
+    counter++;
+  }
+  chacha20_xor(out, in, len, key, nonce, counter);
+}
+
+// The one-time Poly1305 key is the first half of ChaCha20 block 0.
+static void poly1305_key(uint8_t poly_key[64], const uint8_t key[32],
+			 const uint8_t nonce[12]) {
+  memset(poly_key, 0, 64);
+  chacha20(poly_key, poly_key, 64, key, nonce, 0);
+}
+
+// MAC in zero padded to 16 bytes. The padding is part of the message, so
+// every block has the pad bit.
+static void poly1305_padded(void *state, const uint8_t *in, size_t len) {
+  size_t block_len = len & ~15;
+  vector_poly1305_blocks(state, in, block_len, 1);
+  if (len > block_len) {
+    uint8_t buffer[16];
+    memset(buffer, 0, 16);
+    memcpy(buffer, in + block_len, len - block_len);
+    vector_poly1305_blocks(state, buffer, 16, 1);
+  }
+}
+
+static void poly1305_lengths(void *state, size_t ad_len, size_t ct_len) {
+  uint8_t lengths[16];
+  for (int i = 0; i < 8; i++) {
+    lengths[i] = (uint64_t)ad_len >> (8 * i);
+    lengths[8 + i] = (uint64_t)ct_len >> (8 * i);
+  }
+  vector_poly1305_blocks(state, lengths, 16, 1);
+}
+
+static void aead_tag(uint8_t tag[16], const uint8_t poly_key[32],
+		     const uint8_t *ad, size_t ad_len, const uint8_t *ct,
+		     size_t ct_len) {
+  double state[24];  // openssl's scratch space
+  vector_poly1305_init(&state, poly_key);
+  poly1305_padded(&state, ad, ad_len);
+  poly1305_padded(&state, ct, ct_len);
+  poly1305_lengths(&state, ad_len, ct_len);
+  vector_poly1305_emit(&state, tag, poly_key + 16);
+}
+
+// constant time compare
+static int tags_equal(const uint8_t a[16], const uint8_t b[16]) {
+  uint8_t diff = 0;
+  for (int i = 0; i < 16; i++) {
+    diff |= a[i] ^ b[i];
+  }
+  return diff == 0;
+}
+
+void vector_chacha20_poly1305_seal(uint8_t *out, const uint8_t *in,
+				   size_t in_len, const uint8_t *ad,
+				   size_t ad_len, const uint8_t nonce[12],
+				   const uint8_t key[32]) {
+  uint8_t poly_key[64];
+  poly1305_key(poly_key, key, nonce);
+  chacha20_xor(out, in, in_len, key, nonce, 1);
+  aead_tag(out + in_len, poly_key, ad, ad_len, out, in_len);
+  memset(poly_key, 0, 64);
+}
+
+int vector_chacha20_poly1305_open(uint8_t *out, const uint8_t *in,
+				  size_t in_len, const uint8_t *ad,
+				  size_t ad_len, const uint8_t nonce[12],
+				  const uint8_t key[32]) {
+  if (in_len < 16) {
+    return -1;
+  }
+  size_t ct_len = in_len - 16;
+  uint8_t poly_key[64], tag[16];
+  poly1305_key(poly_key, key, nonce);
+  aead_tag(tag, poly_key, ad, ad_len, in, ct_len);
+  memset(poly_key, 0, 64);
+  if (!tags_equal(tag, in + ct_len)) {
+    return -1;
+  }
+  chacha20_xor(out, in, ct_len, key, nonce, 1);
+  return 0;
+}
+
+int vector_chacha20_poly1305_open_stream(uint8_t *out, const uint8_t *in,
+					 size_t in_len, const uint8_t *ad,
+					 size_t ad_len, const uint8_t nonce[12],
+					 const uint8_t key[32]) {
+  if (in_len < AEAD_FUSED_MIN_LEN + 16) {
+    return vector_chacha20_poly1305_open(out, in, in_len, ad, ad_len, nonce,
+					 key);
+  }
+  size_t ct_len = in_len - 16;
+  uint8_t poly_key[64], tag[16];
+  double state[24];  // openssl's scratch space
+  poly1305_key(poly_key, key, nonce);
+  vector_poly1305_init(&state, poly_key);
+  poly1305_padded(&state, ad, ad_len);
+  // Each chunk is MACed before it is decrypted, in case out is in, and is
+  // still in cache when ChaCha20 reads it again.
+  for (size_t offset = 0; offset < ct_len; offset += AEAD_CHUNK_LEN) {
+    size_t len = ct_len - offset;
+    if (len > AEAD_CHUNK_LEN) len = AEAD_CHUNK_LEN;
+    poly1305_padded(&state, in + offset, len);
+    chacha20_xor(out + offset, in + offset, len, key, nonce,
+		 1 + offset / 64);
+  }
+  poly1305_lengths(&state, ad_len, ct_len);
+  vector_poly1305_emit(&state, tag, poly_key + 16);
+  memset(poly_key, 0, 64);
+  if (!tags_equal(tag, in + ct_len)) {
+    memset(out, 0, ct_len);
+    return -1;
+  }
+  return 0;
+}
+
+static void tls13_nonce(uint8_t nonce[12], const uint8_t iv[12],
+			uint64_t seq) {
+  memcpy(nonce, iv, 12);
+  for (int i = 0; i < 8; i++) {
+    nonce[4 + i] ^= seq >> (56 - 8 * i);
+  }
+}
+
+// The keystream for a batch of records: every record's Poly1305 key block,
+// followed by the blocks of short records' data.
+struct tls_batch {
+  uint32_t counter_nonce[TLS_BATCH_RECORDS * (1 + TLS_SHORT_LEN / 64)][4];
+  uint8_t keystream[TLS_BATCH_RECORDS * (1 + TLS_SHORT_LEN / 64)][64];
+  size_t first_block[TLS_BATCH_RECORDS];
+};
+
+static void tls_batch_keystream(struct tls_batch *batch,
+				const struct tls_record *records,
+				size_t num_records, size_t overhead,
+				const uint8_t key[32], const uint8_t iv[12],
+				uint64_t seq) {
+  size_t blocks = 0;
+  for (size_t i = 0; i < num_records; i++) {
+    uint8_t nonce[12];
+    tls13_nonce(nonce, iv, seq + i);
+    size_t len = records[i].in_len - overhead;
+    size_t record_blocks = len <= TLS_SHORT_LEN ? 1 + (len + 63) / 64 : 1;
+    batch->first_block[i] = blocks;
+    for (size_t j = 0; j < record_blocks; j++) {
+      batch->counter_nonce[blocks][0] = j;
+      memcpy(&batch->counter_nonce[blocks][1], nonce, 12);
+      blocks++;
+    }
+  }
+  chacha20_lanes(batch->keystream[0], blocks, key, batch->counter_nonce);
+}
+
+// Encrypts or decrypts a record from its keystream in the batch, or with
+// the nonce from the batch if it is long.
+static void tls_record_xor(const struct tls_batch *batch, size_t i,
+			   uint8_t *out, const uint8_t *in, size_t len,
+			   const uint8_t key[32]) {
+  size_t first = batch->first_block[i];
+  if (len <= TLS_SHORT_LEN) {
+    const uint8_t *keystream = batch->keystream[first + 1];
+    for (size_t j = 0; j < len; j++) {
+      out[j] = in[j] ^ keystream[j];
+    }
+  } else {
+    chacha20_xor(out, in, len, key,
+		 (const uint8_t *)&batch->counter_nonce[first][1], 1);
+  }
+}
+
+void vector_tls13_seal_records(struct tls_record *records, size_t num_records,
+			       const uint8_t key[32], const uint8_t iv[12],
+			       uint64_t seq) {
+  struct tls_batch batch;
+  while (num_records > 0) {
+    size_t n = num_records < TLS_BATCH_RECORDS ? num_records : TLS_BATCH_RECORDS;
+    tls_batch_keystream(&batch, records, n, 0, key, iv, seq);
+    for (size_t i = 0; i < n; i++) {
+      struct tls_record *r = &records[i];
+      tls_record_xor(&batch, i, r->out, r->in, r->in_len, key);
+      aead_tag(r->out + r->in_len, batch.keystream[batch.first_block[i]],
+	       r->ad, r->ad_len, r->out, r->in_len);
+    }
+    records += n;
+    num_records -= n;
+    seq += n;
+  }
+  memset(&batch, 0, sizeof(batch));
+}
+
+size_t vector_tls13_open_records(struct tls_record *records,
+				 size_t num_records, const uint8_t key[32],
+				 const uint8_t iv[12], uint64_t seq) {
+  struct tls_batch batch;
+  size_t opened = 0;
+  while (opened < num_records) {
+    size_t n = 0;
+    while (n < TLS_BATCH_RECORDS && opened + n < num_records &&
+	   records[opened + n].in_len >= 16) {
+      n++;
+    }
+    if (n == 0) {
+      // A record too short to have a tag.
+      break;
+    }
+    tls_batch_keystream(&batch, records + opened, n, 16, key, iv, seq + opened);
+    for (size_t i = 0; i < n; i++) {
+      struct tls_record *r = &records[opened];
+      size_t ct_len = r->in_len - 16;
+      uint8_t tag[16];
+      aead_tag(tag, batch.keystream[batch.first_block[i]], r->ad, r->ad_len,
+	       r->in, ct_len);
+      if (!tags_equal(tag, r->in + ct_len)) {
+	memset(&batch, 0, sizeof(batch));
+	return opened;
+      }
+      tls_record_xor(&batch, i, r->out, r->in, ct_len, key);
+      opened++;
+    }
+  }
+  memset(&batch, 0, sizeof(batch));
+  return opened;
+}
+
+// A batch of requests' keystream, like tls_batch with the key in each block.
+struct request_batch {
+  uint32_t key_counter_nonce[TLS_BATCH_RECORDS * (1 + TLS_SHORT_LEN / 64)][12];
+  uint8_t keystream[TLS_BATCH_RECORDS * (1 + TLS_SHORT_LEN / 64)][64];
+  size_t first_block[TLS_BATCH_RECORDS];
+};
+
+static void request_batch_keystream(struct request_batch *batch,
+				    const struct aead_request *requests,
+				    size_t num_requests) {
+  size_t blocks = 0;
+  for (size_t i = 0; i < num_requests; i++) {
+    const struct aead_request *r = &requests[i];
+    batch->first_block[i] = blocks;
+    if (r->open && r->in_len < 16) {
+      // Too short to have a tag, so it fails without a lane.
+      continue;
+    }
+    size_t len = r->open ? r->in_len - 16 : r->in_len;
+    size_t request_blocks = len <= TLS_SHORT_LEN ? 1 + (len + 63) / 64 : 1;
+    for (size_t j = 0; j < request_blocks; j++) {
+      memcpy(batch->key_counter_nonce[blocks], r->key, 32);
+      batch->key_counter_nonce[blocks][8] = j;
+      memcpy(&batch->key_counter_nonce[blocks][9], r->nonce, 12);
+      blocks++;
+    }
+  }
+  chacha20_keyed_lanes(batch->keystream[0], blocks, batch->key_counter_nonce);
+}
+
+static void request_xor(const struct request_batch *batch, size_t i,
+			const struct aead_request *r, size_t len) {
+  if (len <= TLS_SHORT_LEN) {
+    const uint8_t *keystream = batch->keystream[batch->first_block[i] + 1];
+    for (size_t j = 0; j < len; j++) {
+      r->out[j] = r->in[j] ^ keystream[j];
+    }
+  } else {
+    chacha20_xor(r->out, r->in, len, r->key, r->nonce, 1);
+  }
+}
+
+void vector_chacha20_poly1305_batch(struct aead_request *requests,
+				    size_t num_requests) {
+  struct request_batch batch;
+  while (num_requests > 0) {
+    size_t n = num_requests < TLS_BATCH_RECORDS ? num_requests : TLS_BATCH_RECORDS;
+    request_batch_keystream(&batch, requests, n);
+    for (size_t i = 0; i < n; i++) {
+      struct aead_request *r = &requests[i];
+      const uint8_t *poly_key = batch.keystream[batch.first_block[i]];
+      if (!r->open) {
+	request_xor(&batch, i, r, r->in_len);
+	aead_tag(r->out + r->in_len, poly_key, r->ad, r->ad_len, r->out,
+		 r->in_len);
+	r->result = 0;
+      } else if (r->in_len < 16) {
+	r->result = -1;
+      } else {
+	size_t ct_len = r->in_len - 16;
+	uint8_t tag[16];
+	aead_tag(tag, poly_key, r->ad, r->ad_len, r->in, ct_len);
+	r->result = tags_equal(tag, r->in + ct_len) ? 0 : -1;
+	if (r->result == 0) {
+	  request_xor(&batch, i, r, ct_len);
+	}
+      }
+    }
+    requests += n;
+    num_requests -= n;
+  }
+  memset(&batch, 0, sizeof(batch));
+}
+
+void vector_quic_hp_masks(uint8_t masks[][5], const uint8_t samples[][16],
+			  size_t num_packets, const uint8_t key[32]) {
+  chacha20_hp_masks(masks, num_packets, key, samples);
+}
+
+// The original ChaCha has a 64-bit counter and a 64-bit nonce, which for
+// counters below 2^32 is the RFC 8439 cipher with a zero word before the
+// nonce. OpenSSH's nonce is the big endian sequence number.
+static void ssh_nonce(uint8_t nonce[12], uint32_t seqnr) {
+  memset(nonce, 0, 8);
+  for (int i = 0; i < 4; i++) {
+    nonce[8 + i] = seqnr >> (24 - 8 * i);
+  }
+}
+
+// Plain Poly1305 over the encrypted length and payload, no padding.
+static void ssh_tag(uint8_t tag[16], const uint8_t poly_key[32],
+		    const uint8_t *in, size_t len) {
+  double state[24];  // openssl's scratch space
+  vector_poly1305_init(&state, poly_key);
+  size_t block_len = len & ~15;
+  vector_poly1305_blocks(&state, in, block_len, 1);
+  if (len > block_len) {
+    size_t tail_len = len & 15;
+    uint8_t buffer[16];
+    memset(buffer, 0, 16);
+    memcpy(buffer, in + block_len, tail_len);
+    buffer[tail_len] = 1;
+    vector_poly1305_blocks(&state, buffer, 16, 0);
+  }
+  vector_poly1305_emit(&state, tag, poly_key + 16);
+}
+
+void vector_openssh_chacha20_poly1305_seal(uint8_t *out, const uint8_t *in,
+					   size_t in_len, uint32_t seqnr,
+					   const uint8_t key[64]) {
+  uint8_t nonce[12], poly_key[64];
+  ssh_nonce(nonce, seqnr);
+  poly1305_key(poly_key, key, nonce);
+  chacha20_xor(out, in, 4, key + 32, nonce, 0);
+  chacha20_xor(out + 4, in + 4, in_len - 4, key, nonce, 1);
+  ssh_tag(out + in_len, poly_key, out, in_len);
+  memset(poly_key, 0, 64);
+}
+
+int vector_openssh_chacha20_poly1305_open(uint8_t *out, const uint8_t *in,
+					  size_t in_len, uint32_t seqnr,
+					  const uint8_t key[64]) {
+  if (in_len < 20) {
+    return -1;
+  }
+  size_t ct_len = in_len - 16;
+  uint8_t nonce[12], poly_key[64], tag[16];
+  ssh_nonce(nonce, seqnr);
+  poly1305_key(poly_key, key, nonce);
+  ssh_tag(tag, poly_key, in, ct_len);
+  memset(poly_key, 0, 64);
+  if (!tags_equal(tag, in + ct_len)) {
+    return -1;
+  }
+  chacha20_xor(out, in, 4, key + 32, nonce, 0);
+  chacha20_xor(out + 4, in + 4, ct_len - 4, key, nonce, 1);
+  return 0;
+}
+
+uint32_t vector_openssh_get_length(const uint8_t in[4], uint32_t seqnr,
+				   const uint8_t key[64]) {
+  uint8_t keystream[1][4];
+  vector_openssh_length_keystreams(keystream, 1, seqnr, key);
+  uint32_t length = 0;
+  for (int i = 0; i < 4; i++) {
+    length = (length << 8) | (in[i] ^ keystream[0][i]);
+  }
+  return length;
+}
+
+// Block 0 of the length key, whose first bytes the QUIC header protection
+// kernel already computes lane by lane.
+void vector_openssh_length_keystreams(uint8_t keystreams[][4],
+				      size_t num_packets, uint32_t seqnr,
+				      const uint8_t key[64]) {
+  uint32_t counter_nonce[SSH_LENGTH_LANES][4];
+  uint8_t masks[SSH_LENGTH_LANES][5];
+  while (num_packets > 0) {
+    size_t n = num_packets < SSH_LENGTH_LANES ? num_packets : SSH_LENGTH_LANES;
+    for (size_t i = 0; i < n; i++) {
+      counter_nonce[i][0] = 0;
+      ssh_nonce((uint8_t *)&counter_nonce[i][1], seqnr + i);
+    }
+    chacha20_hp_masks(masks, n, key + 32,
+		      (const uint8_t(*)[16])counter_nonce);
+    for (size_t i = 0; i < n; i++) {
+      memcpy(keystreams[i], masks[i], 4);
+    }
+    keystreams += n;
+    num_packets -= n;
+    seqnr += n;
+  }
+  memset(masks, 0, sizeof(masks));
+}
+
+int vector_chacha20_poly1305_ring_init(struct chacha20_poly1305_ring *ring,
+				       size_t num_slots, size_t slot_len,
+				       const uint8_t key[32],
+				       const uint8_t iv[12], uint64_t seq) {
+  memcpy(ring->key, key, 32);
+  memcpy(ring->iv, iv, 12);
+  ring->seq = seq;
+  ring->ready = 0;
+  ring->num_slots = num_slots;
+  ring->slot_len = (slot_len + 63) & ~(size_t)63;
+  size_t slot_blocks = 1 + ring->slot_len / 64;
+  ring->keystream = malloc(num_slots * slot_blocks * 64);
+  ring->counter_nonce = malloc(num_slots * slot_blocks * 16);
+  if (ring->keystream == NULL || ring->counter_nonce == NULL) {
+    vector_chacha20_poly1305_ring_free(ring);
+    return -1;
+  }
+  return 0;
+}
+
+void vector_chacha20_poly1305_ring_free(struct chacha20_poly1305_ring *ring) {
+  if (ring->keystream != NULL) {
+    memset(ring->keystream, 0, ring->num_slots * (64 + ring->slot_len));
+  }
+  free(ring->keystream);
+  free(ring->counter_nonce);
+  memset(ring, 0, sizeof(*ring));
+}
+
+// Fills slots first to first + n - 1, which don't wrap, in one pass over
+// the vector lanes.
+static void ring_fill_slots(struct chacha20_poly1305_ring *ring, size_t first,
+			    size_t n, uint64_t seq) {
+  size_t slot_blocks = 1 + ring->slot_len / 64;
+  uint32_t (*counter_nonce)[4] = ring->counter_nonce;
+  for (size_t i = 0; i < n; i++) {
+    uint8_t nonce[12];
+    tls13_nonce(nonce, ring->iv, seq + i);
+    for (size_t j = 0; j < slot_blocks; j++) {
+      counter_nonce[j][0] = j;
+      memcpy(&counter_nonce[j][1], nonce, 12);
+    }
+    counter_nonce += slot_blocks;
+  }
+  chacha20_lanes(ring->keystream + first * slot_blocks * 64, n * slot_blocks,
+		 ring->key, ring->counter_nonce);
+}
+
+size_t vector_chacha20_poly1305_ring_fill(struct chacha20_poly1305_ring *ring,
+					  size_t max_packets) {
+  size_t n = ring->num_slots - ring->ready;
+  if (n > max_packets) {
+    n = max_packets;
+  }
+  uint64_t seq = ring->seq + ring->ready;
+  size_t first = seq % ring->num_slots;
+  size_t before_wrap = ring->num_slots - first;
+  if (n <= before_wrap) {
+    ring_fill_slots(ring, first, n, seq);
+  } else {
+    ring_fill_slots(ring, first, before_wrap, seq);
+    ring_fill_slots(ring, 0, n - before_wrap, seq + before_wrap);
+  }
+  ring->ready += n;
+  return n;
+}
+
+void vector_chacha20_poly1305_ring_seal(struct chacha20_poly1305_ring *ring,
+					uint8_t *out, const uint8_t *in,
+					size_t in_len, const uint8_t *ad,
+					size_t ad_len) {
+  uint8_t *slot = ring->keystream +
+		  (ring->seq % ring->num_slots) * (64 + ring->slot_len);
+  if (ring->ready > 0 && in_len <= ring->slot_len) {
+    vector_xor(out, in, slot + 64, in_len);
+    aead_tag(out + in_len, slot, ad, ad_len, out, in_len);
+  } else {
+    uint8_t nonce[12];
+    tls13_nonce(nonce, ring->iv, ring->seq);
+    vector_chacha20_poly1305_seal(out, in, in_len, ad, ad_len, nonce,
+				  ring->key);
+  }
+  // The packet's slot is used up either way, so its keystream goes.
+  if (ring->ready > 0) {
+    memset(slot, 0, 64 + ring->slot_len);
+    ring->ready--;
+  }
+  ring->seq++;
+}
@@ -0,0 +1,174 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every function here encrypts or decrypts with out == in, or with out before
+// in (out = in - k) to strip a header in front of the ciphertext without a
+// copy. out must not start inside the input after in. Opening reads the
+// additional data before writing out, so it may be that stripped header.
+
+// ChaCha20 starting offset bytes into the keystream of key and nonce, for
+// reading and writing ranges of a large encrypted blob. A partial block at
+// either end goes through a buffer, and the rest is whole vector batches.
+// offset + len must be at most 2^38, where the 32-bit block counter wraps.
+void vector_chacha20_at(uint8_t *out, const uint8_t *in, size_t len,
+			const uint8_t key[32], const uint8_t nonce[12],
+			uint64_t offset);
+
+// ChaCha20-Poly1305 as in RFC 8439, with the 16-byte tag after the
+// ciphertext like BoringSSL's EVP_AEAD. out is in_len + 16 bytes.
+void vector_chacha20_poly1305_seal(uint8_t *out, const uint8_t *in,
+				   size_t in_len, const uint8_t *ad,
+				   size_t ad_len, const uint8_t nonce[12],
+				   const uint8_t key[32]);
+
+// Runs Poly1305 over the ciphertext and checks the tag before any ChaCha20,
+// so a forgery costs only the MAC. Returns 0 and writes in_len - 16 bytes of
+// plaintext to out on success, and -1 without writing out on failure. out
+// may be in to decrypt in place.
+int vector_chacha20_poly1305_open(uint8_t *out, const uint8_t *in,
+				  size_t in_len, const uint8_t *ad,
+				  size_t ad_len, const uint8_t nonce[12],
+				  const uint8_t key[32]);
+
+// open for records of any size. Below AEAD_FUSED_MIN_LEN bytes this is open.
+// Past that, reading the ciphertext twice costs more than it saves, so it
+// MACs and decrypts one cache-sized chunk at a time instead, and on failure
+// zeroes the in_len - 16 bytes of out before returning -1.
+int vector_chacha20_poly1305_open_stream(uint8_t *out, const uint8_t *in,
+					 size_t in_len, const uint8_t *ad,
+					 size_t ad_len, const uint8_t nonce[12],
+					 const uint8_t key[32]);
+
+// A TLS 1.3 record for the batch functions. For seal, in_len is the
+// plaintext length and out gets in_len + 16 bytes. For open, in_len includes
+// the tag and out gets in_len - 16 bytes, and may be in. The additional data
+// is the record header.
+struct tls_record {
+  uint8_t *out;
+  const uint8_t *in;
+  size_t in_len;
+  const uint8_t *ad;
+  size_t ad_len;
+};
+
+// Seals num_records records back to back under one key, with the nonce of
+// record i being iv xor the big endian sequence number seq + i, as in TLS 1.3
+// and DTLS 1.3. Records of up to TLS_SHORT_LEN bytes are spread across the
+// vector lanes with their Poly1305 keys, and longer ones only have their
+// Poly1305 keys batched.
+void vector_tls13_seal_records(struct tls_record *records, size_t num_records,
+			       const uint8_t key[32], const uint8_t iv[12],
+			       uint64_t seq);
+
+// Opens records like vector_chacha20_poly1305_open, and stops at the first
+// that fails, which is fatal to a TLS connection. Returns the number of
+// records opened.
+size_t vector_tls13_open_records(struct tls_record *records,
+				 size_t num_records, const uint8_t key[32],
+				 const uint8_t iv[12], uint64_t seq);
+
+// A seal or open under its own key and nonce, for
+// vector_chacha20_poly1305_batch. in_len and out are as for tls_record.
+// result is set to 0, or to -1 for an open that failed, which leaves out
+// untouched.
+struct aead_request {
+  uint8_t *out;
+  const uint8_t *in;
+  size_t in_len;
+  const uint8_t *ad;
+  size_t ad_len;
+  const uint8_t *nonce;
+  const uint8_t *key;
+  int open;
+  int result;
+};
+
+// Seals and opens unrelated messages together, like
+// vector_tls13_seal_records, but with the key in each lane as well, so
+// messages from different flows fill the vector lanes together.
+void vector_chacha20_poly1305_batch(struct aead_request *requests,
+				    size_t num_requests);
+
+// QUIC header protection masks (RFC 9001 5.4.4): masks[i] is the first 5
+// bytes of the ChaCha20 block whose counter and nonce are samples[i], one
+// packet per vector lane. samples must be 4 byte aligned.
+void vector_quic_hp_masks(uint8_t masks[][5], const uint8_t samples[][16],
+			  size_t num_packets, const uint8_t key[32]);
+
+// chacha20-poly1305@openssh.com, as in OpenSSH's PROTOCOL.chacha20poly1305.
+// key is 64 bytes: the payload key, then the key for the 4-byte packet
+// length. in is the packet length followed by the rest of the packet, so
+// in_len is at least 4, and out gets in_len + 16 bytes.
+void vector_openssh_chacha20_poly1305_seal(uint8_t *out, const uint8_t *in,
+					   size_t in_len, uint32_t seqnr,
+					   const uint8_t key[64]);
+
+// Checks the tag before decrypting anything, returning 0 on success and -1
+// on failure, when out is untouched. in_len includes the tag, and out may be
+// in.
+int vector_openssh_chacha20_poly1305_open(uint8_t *out, const uint8_t *in,
+					  size_t in_len, uint32_t seqnr,
+					  const uint8_t key[64]);
+
+// Decrypts the packet length from the first 4 bytes of a packet.
+uint32_t vector_openssh_get_length(const uint8_t in[4], uint32_t seqnr,
+				   const uint8_t key[64]);
+
+// The keystreams that encrypt the packet lengths of packets seqnr to
+// seqnr + num_packets - 1, one packet per vector lane. They don't depend on
+// the packets, so a reader can compute them ahead and decrypt each length
+// with a 4-byte xor as the packets arrive, the length being big endian.
+void vector_openssh_length_keystreams(uint8_t keystreams[][4],
+				      size_t num_packets, uint32_t seqnr,
+				      const uint8_t key[64]);
+
+// Keystream precomputed ahead of a flow's packets, so that sealing a packet
+// that fits a slot is only a vector xor and the MAC. Nonces follow TLS 1.3,
+// iv xor the big endian sequence number.
+struct chacha20_poly1305_ring {
+  uint8_t key[32];
+  uint8_t iv[12];
+  uint64_t seq;  // the next packet to seal
+  size_t ready;  // packets from seq on with keystream in their slots
+  size_t num_slots;
+  size_t slot_len;  // the longest plaintext a slot covers, a multiple of 64
+  uint8_t *keystream;  // per slot, the Poly1305 key block then slot_len bytes
+  uint32_t (*counter_nonce)[4];
+};
+
+// Returns 0, or -1 if the ring can't be allocated.
+int vector_chacha20_poly1305_ring_init(struct chacha20_poly1305_ring *ring,
+				       size_t num_slots, size_t slot_len,
+				       const uint8_t key[32],
+				       const uint8_t iv[12], uint64_t seq);
+
+void vector_chacha20_poly1305_ring_free(struct chacha20_poly1305_ring *ring);
+
+// Precomputes keystream for up to max_packets more packets, for idle time.
+// Returns how many were added.
+size_t vector_chacha20_poly1305_ring_fill(struct chacha20_poly1305_ring *ring,
+					  size_t max_packets);
+
+// Seals the packet with sequence number ring->seq, like
+// vector_chacha20_poly1305_seal. Packets longer than a slot, or arriving
+// when the ring is empty, are sealed from scratch.
+void vector_chacha20_poly1305_ring_seal(struct chacha20_poly1305_ring *ring,
+					uint8_t *out, const uint8_t *in,
+					size_t in_len, const uint8_t *ad,
+					size_t ad_len);
@@ -0,0 +1,168 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include "arena.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define HUGE_PAGE (2 << 20)
+#define MIN_CLASS 6  // 64 bytes
+// The largest class's buffers. Longer requests have no free list.
+#define MAX_LEN ((size_t)1 << (ARENA_CLASSES - 1 + MIN_CLASS))
+
+// Each thread's slot in every arena's free lists, handed out on first use
+// and handed back by a key destructor when the thread exits, so a later
+// thread takes over the lists and reuses what was freed on them.
+// ARENA_MAX_THREADS while the thread has none.
+static __thread int thread_slot = -1;
+static uint8_t slot_taken[ARENA_MAX_THREADS];
+static pthread_mutex_t slot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+
+// The key's value is the slot + 1, since a NULL value skips the destructor.
+static void put_thread_slot(void *value) {
+  pthread_mutex_lock(&slot_lock);
+  slot_taken[(intptr_t)value - 1] = 0;
+  pthread_mutex_unlock(&slot_lock);
+  thread_slot = ARENA_MAX_THREADS;
+}
+
+static void create_slot_key(void) {
+  pthread_key_create(&slot_key, put_thread_slot);
+}
+
+static int get_thread_slot(void) {
+  if (thread_slot < 0) {
+    thread_slot = ARENA_MAX_THREADS;
+    pthread_once(&slot_key_once, create_slot_key);
+    pthread_mutex_lock(&slot_lock);
+    for (int i = 0; i < ARENA_MAX_THREADS; i++) {
+      if (!slot_taken[i]) {
+	slot_taken[i] = 1;
+	thread_slot = i;
+	break;
+      }
+    }
+    pthread_mutex_unlock(&slot_lock);
+    if (thread_slot < ARENA_MAX_THREADS) {
+      pthread_setspecific(slot_key, (void *)(intptr_t)(thread_slot + 1));
+    }
+  }
+  return thread_slot;
+}
+
+// The smallest class whose buffers hold len bytes.
+static int size_class(size_t len) {
+  int c = 0;
+  while (((size_t)1 << (c + MIN_CLASS)) < len) {
+    c++;
+  }
+  return c;
+}
+
+// What a request for len bytes carves: its class, or from a huge page up,
+// its length rounded up to huge pages, so a large buffer doesn't cost up to
+// twice its length.
+static size_t block_len(size_t len) {
+  if (len >= HUGE_PAGE) {
+    return (len + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+  }
+  return (size_t)1 << (size_class(len) + MIN_CLASS);
+}
+
+// The largest class whose buffers fit in a block of len bytes, which is the
+// list a freed block goes on, so any buffer on class c's list holds a
+// request of class c.
+static int free_class(size_t len) {
+  int c = size_class(len);
+  if (((size_t)1 << (c + MIN_CLASS)) > len) {
+    c--;
+  }
+  return c;
+}
+
+int arena_init(struct arena *arena, size_t size) {
+  memset(arena, 0, sizeof(*arena));
+  size = (size + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) {
+    arena->hugetlb = 1;
+  } else {
+    // Map an extra huge page to align the start to one, so that THP can back
+    // the whole arena, then trim the ends.
+    uint8_t *q = mmap(NULL, size + HUGE_PAGE, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (q == MAP_FAILED) {
+      return -1;
+    }
+    uint8_t *aligned = (uint8_t *)(((uintptr_t)q + HUGE_PAGE - 1) &
+				   ~(uintptr_t)(HUGE_PAGE - 1));
+    if (aligned > q) {
+      munmap(q, aligned - q);
+    }
+    if (aligned + size < q + size + HUGE_PAGE) {
+      munmap(aligned + size, q + HUGE_PAGE - aligned);
+    }
+    madvise(aligned, size, MADV_HUGEPAGE);
+    p = aligned;
+  }
+  arena->base = p;
+  arena->size = size;
+  return 0;
+}
+
+void arena_destroy(struct arena *arena) {
+  if (arena->base != NULL) {
+    munmap(arena->base, arena->size);
+  }
+  memset(arena, 0, sizeof(*arena));
+}
+
+void *arena_alloc(struct arena *arena, size_t len) {
+  if (len > MAX_LEN) {
+    return NULL;
+  }
+  int c = size_class(len);
+  int slot = get_thread_slot();
+  if (slot < ARENA_MAX_THREADS && arena->free_lists[slot][c] != NULL) {
+    void *p = arena->free_lists[slot][c];
+    memcpy(&arena->free_lists[slot][c], p, sizeof(void *));
+    return p;
+  }
+  size_t carve_len = block_len(len);
+  size_t used = __atomic_load_n(&arena->used, __ATOMIC_RELAXED);
+  do {
+    if (carve_len > arena->size - used) {
+      return NULL;
+    }
+  } while (!__atomic_compare_exchange_n(&arena->used, &used, used + carve_len,
+					1, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED));
+  return arena->base + used;
+}
+
+void arena_free(struct arena *arena, void *p, size_t len) {
+  int slot = get_thread_slot();
+  if (p == NULL || slot >= ARENA_MAX_THREADS) {
+    return;
+  }
+  int c = free_class(block_len(len));
+  memcpy(p, &arena->free_lists[slot][c], sizeof(void *));
+  arena->free_lists[slot][c] = p;
+}
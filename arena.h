@@ -0,0 +1,57 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Buffers for batches and benchmarks carved out of one mapping on 2 MB
+// pages, so streaming through megabytes of records doesn't miss in the TLB
+// every 4 KB. The mapping uses MAP_HUGETLB pages when the system has them
+// reserved, and otherwise asks for transparent huge pages with madvise.
+//
+// Buffers are 64-byte aligned. Under 2 MB they come in power of two size
+// classes from 64 bytes, so a buffer can take up to twice the memory asked
+// for, and from 2 MB up they take their length rounded up to a 2 MB page.
+// Size an arena by those rounded lengths. Freed buffers go on the freeing
+// thread's own list for the largest class they hold, and allocation takes
+// from the calling thread's list before carving more of the mapping, so
+// neither takes a lock. An exited thread's lists pass to the next thread
+// to allocate. Threads running alongside ARENA_MAX_THREADS others have
+// none, so they only carve, and what they free is reclaimed by
+// arena_destroy.
+
+#define ARENA_MAX_THREADS 64
+#define ARENA_CLASSES 40
+
+struct arena {
+  uint8_t *base;
+  size_t size;
+  size_t used;  // carved from base, advanced with compare and swap
+  int hugetlb;  // 1 on MAP_HUGETLB pages, 0 on transparent huge pages
+  void *free_lists[ARENA_MAX_THREADS][ARENA_CLASSES];
+};
+
+// Maps size bytes, rounded up to a 2 MB page. Returns 0, or -1 if even the
+// fallback mapping fails.
+int arena_init(struct arena *arena, size_t size);
+
+void arena_destroy(struct arena *arena);
+
+// A 64-byte aligned buffer of at least len bytes, or NULL if the arena is
+// full or len is over the largest class, 2^(ARENA_CLASSES + 5) bytes.
+void *arena_alloc(struct arena *arena, size_t len);
+
+// Returns a buffer from arena_alloc, with the len it was allocated with.
+void arena_free(struct arena *arena, void *p, size_t len);
@@ -0,0 +1,155 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include "batcher.h"
+
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// Takes up to max_batch jobs off the queue and runs them. Called and returns
+// with the lock held, but doesn't hold it while running the batch.
+static void run_batch(struct aead_batcher *batcher) {
+  struct aead_job *jobs[BATCHER_MAX_BATCH];
+  struct aead_request requests[BATCHER_MAX_BATCH];
+  size_t n = 0;
+  while (batcher->head != NULL && n < batcher->max_batch) {
+    jobs[n++] = batcher->head;
+    batcher->head = batcher->head->next;
+  }
+  if (batcher->head == NULL) {
+    batcher->tail = NULL;
+  }
+  batcher->num_pending -= n;
+  batcher->num_batches++;
+  batcher->num_jobs += n;
+  pthread_mutex_unlock(&batcher->lock);
+
+  for (size_t i = 0; i < n; i++) {
+    requests[i] = jobs[i]->request;
+  }
+  vector_chacha20_poly1305_batch(requests, n);
+  for (size_t i = 0; i < n; i++) {
+    jobs[i]->request.result = requests[i].result;
+    if (jobs[i]->done != NULL) {
+      jobs[i]->done(jobs[i]);
+    } else {
+      __atomic_store_n(&jobs[i]->finished, 1, __ATOMIC_RELEASE);
+    }
+  }
+
+  pthread_mutex_lock(&batcher->lock);
+  pthread_cond_broadcast(&batcher->finished);
+}
+
+// Sleeps until the oldest job's deadline, and runs its batch if nothing
+// filled it first.
+static void *deadline_thread(void *arg) {
+  struct aead_batcher *batcher = arg;
+  pthread_mutex_lock(&batcher->lock);
+  while (!batcher->stopping) {
+    if (batcher->head == NULL) {
+      pthread_cond_wait(&batcher->pending, &batcher->lock);
+      continue;
+    }
+    uint64_t due = batcher->head->submitted_ns + batcher->deadline_ns;
+    if (now_ns() < due) {
+      struct timespec t = {due / 1000000000, due % 1000000000};
+      pthread_cond_timedwait(&batcher->pending, &batcher->lock, &t);
+      continue;
+    }
+    run_batch(batcher);
+  }
+  pthread_mutex_unlock(&batcher->lock);
+  return NULL;
+}
+
+int aead_batcher_init(struct aead_batcher *batcher, size_t max_batch,
+		      uint64_t deadline_ns) {
+  memset(batcher, 0, sizeof(*batcher));
+  if (max_batch < 1) max_batch = 1;
+  if (max_batch > BATCHER_MAX_BATCH) max_batch = BATCHER_MAX_BATCH;
+  batcher->max_batch = max_batch;
+  batcher->deadline_ns = deadline_ns;
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_mutex_init(&batcher->lock, NULL);
+  pthread_cond_init(&batcher->pending, &attr);
+  pthread_cond_init(&batcher->finished, NULL);
+  pthread_condattr_destroy(&attr);
+  if (pthread_create(&batcher->thread, NULL, deadline_thread, batcher) != 0) {
+    pthread_cond_destroy(&batcher->pending);
+    pthread_cond_destroy(&batcher->finished);
+    pthread_mutex_destroy(&batcher->lock);
+    return -1;
+  }
+  return 0;
+}
+
+void aead_batcher_destroy(struct aead_batcher *batcher) {
+  pthread_mutex_lock(&batcher->lock);
+  batcher->stopping = 1;
+  pthread_cond_signal(&batcher->pending);
+  pthread_mutex_unlock(&batcher->lock);
+  pthread_join(batcher->thread, NULL);
+  aead_batcher_flush(batcher);
+  pthread_cond_destroy(&batcher->pending);
+  pthread_cond_destroy(&batcher->finished);
+  pthread_mutex_destroy(&batcher->lock);
+}
+
+void aead_batcher_submit(struct aead_batcher *batcher, struct aead_job *job) {
+  job->submitted_ns = now_ns();
+  job->next = NULL;
+  job->finished = 0;
+  pthread_mutex_lock(&batcher->lock);
+  if (batcher->tail != NULL) {
+    batcher->tail->next = job;
+  } else {
+    batcher->head = job;
+  }
+  batcher->tail = job;
+  batcher->num_pending++;
+  if (batcher->num_pending >= batcher->max_batch) {
+    run_batch(batcher);
+  } else if (batcher->num_pending == 1) {
+    // A new oldest job, so a new deadline.
+    pthread_cond_signal(&batcher->pending);
+  }
+  pthread_mutex_unlock(&batcher->lock);
+}
+
+void aead_batcher_flush(struct aead_batcher *batcher) {
+  pthread_mutex_lock(&batcher->lock);
+  while (batcher->head != NULL) {
+    run_batch(batcher);
+  }
+  pthread_mutex_unlock(&batcher->lock);
+}
+
+int aead_job_wait(struct aead_batcher *batcher, struct aead_job *job) {
+  pthread_mutex_lock(&batcher->lock);
+  while (!__atomic_load_n(&job->finished, __ATOMIC_ACQUIRE)) {
+    pthread_cond_wait(&batcher->finished, &batcher->lock);
+  }
+  pthread_mutex_unlock(&batcher->lock);
+  return job->request.result;
+}
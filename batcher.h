@@ -0,0 +1,73 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "aead.h"
+
+// Coalesces seals and opens submitted by many threads into batches for
+// vector_chacha20_poly1305_batch, so that threads with one small message at
+// a time still fill the vector lanes together. A batch goes out once
+// max_batch jobs are waiting, on the thread whose submission filled it, or
+// once its oldest job has waited deadline_ns, on the batcher's own thread.
+
+#define BATCHER_MAX_BATCH 256
+
+struct aead_job {
+  struct aead_request request;
+  // Called on the thread that ran the batch, with request.result set. The
+  // job is the callback's from then on, and aead_job_wait can't be used. If
+  // NULL, the submitter waits with aead_job_wait instead.
+  void (*done)(struct aead_job *job);
+  void *arg;  // for done
+  // Private to the batcher.
+  uint64_t submitted_ns;
+  struct aead_job *next;
+  int finished;
+};
+
+struct aead_batcher {
+  pthread_mutex_t lock;
+  pthread_cond_t pending;  // wakes the deadline thread
+  pthread_cond_t finished;  // wakes aead_job_wait
+  struct aead_job *head, *tail;
+  size_t num_pending;
+  size_t max_batch;
+  uint64_t deadline_ns;
+  int stopping;
+  pthread_t thread;
+  // How many batches ran and the jobs in them, for the mean batch size.
+  uint64_t num_batches;
+  uint64_t num_jobs;
+};
+
+// max_batch is capped at BATCHER_MAX_BATCH. Returns 0, or -1 if the
+// deadline thread can't be started.
+int aead_batcher_init(struct aead_batcher *batcher, size_t max_batch,
+		      uint64_t deadline_ns);
+
+// Runs the jobs still waiting and stops the deadline thread.
+void aead_batcher_destroy(struct aead_batcher *batcher);
+
+// Queues job, whose request must stay valid until it completes.
+void aead_batcher_submit(struct aead_batcher *batcher, struct aead_job *job);
+
+// Runs every waiting job now, in batches of up to max_batch.
+void aead_batcher_flush(struct aead_batcher *batcher);
+
+// Waits for a job submitted without a callback, and returns its
+// request.result.
+int aead_job_wait(struct aead_batcher *batcher, struct aead_job *job);
@@ -14,6 +14,6 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-clang -march=rv64gcvb main.c boring.c openssl.c vchacha.S vpoly.S -o main -O2 -static || exit 1
+clang -march=rv64gcvb $CFLAGS main.c boring.c openssl.c secretbox.c blake.c aead.c arena.c batcher.c intrinsics.c lazymap.c stats.c vchacha.S vpoly.S -o main -O2 -static -pthread || exit 1
 
 ./main -b $@
@@ -0,0 +1,288 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include "blake.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __riscv_zvkb
+#define blake3_hash_many vector_blake3_hash_many_zvkb
+#define blake2s_blocks vector_blake2s_blocks_zvkb
+#else
+#define blake3_hash_many vector_blake3_hash_many
+#define blake2s_blocks vector_blake2s_blocks
+#endif
+
+static const uint32_t IV[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static uint32_t rotr32(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+// The G function both hashes share, for the blocks the vector code doesn't
+// take: the partial chunk and the root in BLAKE3, and the last block of each
+// leaf and the root in BLAKE2sp.
+static void g(uint32_t v[16], int a, int b, int c, int d, uint32_t x,
+	      uint32_t y) {
+  v[a] += v[b] + x;
+  v[d] = rotr32(v[d] ^ v[a], 16);
+  v[c] += v[d];
+  v[b] = rotr32(v[b] ^ v[c], 12);
+  v[a] += v[b] + y;
+  v[d] = rotr32(v[d] ^ v[a], 8);
+  v[c] += v[d];
+  v[b] = rotr32(v[b] ^ v[c], 7);
+}
+
+static void blake_round(uint32_t v[16], const uint32_t m[16],
+			const uint8_t s[16]) {
+  g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+  g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+  g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+  g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+  g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+  g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+  g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+  g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+}
+
+/* BLAKE3 */
+
+#define CHUNK_LEN 1024
+
+enum {
+  CHUNK_START = 1 << 0,
+  CHUNK_END = 1 << 1,
+  PARENT = 1 << 2,
+  ROOT = 1 << 3,
+  KEYED_HASH = 1 << 4,
+  DERIVE_KEY_CONTEXT = 1 << 5,
+  DERIVE_KEY_MATERIAL = 1 << 6,
+};
+
+static const uint8_t blake3_schedule[7][16] = {
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+  {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+  {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+  {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+  {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+  {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+  {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+static void blake3_compress(uint32_t cv[8], const uint8_t block[64],
+			    uint32_t block_len, uint64_t counter,
+			    uint32_t flags) {
+  uint32_t m[16], v[16];
+  memcpy(m, block, 64);
+  memcpy(v, cv, 32);
+  memcpy(v + 8, IV, 16);
+  v[12] = (uint32_t)counter;
+  v[13] = (uint32_t)(counter >> 32);
+  v[14] = block_len;
+  v[15] = flags;
+  for (int r = 0; r < 7; r++) {
+    blake_round(v, m, blake3_schedule[r]);
+  }
+  for (int i = 0; i < 8; i++) {
+    cv[i] = v[i] ^ v[i + 8];
+  }
+}
+
+// The last chunk, which may be partial, one block at a time.
+static void blake3_chunk(uint32_t cv[8], const uint32_t key[8],
+			 const uint8_t *in, size_t len, uint64_t counter,
+			 uint32_t flags, uint32_t end_flags) {
+  memcpy(cv, key, 32);
+  flags |= CHUNK_START;
+  do {
+    uint8_t block[64];
+    size_t block_len = len < 64 ? len : 64;
+    memset(block, 0, 64);
+    memcpy(block, in, block_len);
+    in += block_len;
+    len -= block_len;
+    if (len == 0) {
+      flags |= CHUNK_END | end_flags;
+    }
+    blake3_compress(cv, block, block_len, counter, flags);
+    flags &= ~CHUNK_START;
+  } while (len > 0);
+}
+
+static void blake3_hash(uint8_t out[32], const uint8_t *in, size_t len,
+			const uint32_t key[8], uint32_t flags) {
+  uint32_t cv[8];
+  size_t num_chunks = len == 0 ? 1 : (len + CHUNK_LEN - 1) / CHUNK_LEN;
+  size_t last_chunk = (num_chunks - 1) * CHUNK_LEN;
+  if (num_chunks == 1) {
+    blake3_chunk(cv, key, in, len, 0, flags, ROOT);
+    memcpy(out, cv, 32);
+    return;
+  }
+
+  // All but the last chunk are whole, and go to the vector code.
+  uint8_t *cvs = malloc(num_chunks * 32);
+  blake3_hash_many(cvs, in, num_chunks - 1, CHUNK_LEN / 64, key, 0, 1,
+		   flags | CHUNK_START << 8 | CHUNK_END << 16);
+  blake3_chunk(cv, key, in + last_chunk, len - last_chunk, num_chunks - 1,
+	       flags, 0);
+  memcpy(cvs + (num_chunks - 1) * 32, cv, 32);
+
+  // Merge neighbouring chaining values a layer at a time, carrying an odd one
+  // up to the next layer, which builds the same left-full tree as the spec,
+  // until only the children of the root are left.
+  size_t n = num_chunks;
+  while (n > 2) {
+    blake3_hash_many(cvs, cvs, n / 2, 1, key, 0, 0, flags | PARENT);
+    if (n & 1) {
+      memcpy(cvs + (n / 2) * 32, cvs + (n - 1) * 32, 32);
+    }
+    n = (n + 1) / 2;
+  }
+  memcpy(cv, key, 32);
+  blake3_compress(cv, cvs, 64, 0, flags | PARENT | ROOT);
+  memcpy(out, cv, 32);
+  free(cvs);
+}
+
+void vector_blake3(uint8_t out[32], const uint8_t *in, size_t in_len) {
+  blake3_hash(out, in, in_len, IV, 0);
+}
+
+void vector_blake3_keyed(uint8_t out[32], const uint8_t *in, size_t in_len,
+			 const uint8_t key[32]) {
+  uint32_t key_words[8];
+  memcpy(key_words, key, 32);
+  blake3_hash(out, in, in_len, key_words, KEYED_HASH);
+}
+
+void vector_blake3_derive_key(uint8_t out[32], const char *context,
+			      const uint8_t *material, size_t material_len) {
+  uint32_t context_key[8];
+  blake3_hash((uint8_t*)context_key, (const uint8_t*)context, strlen(context),
+	      IV, DERIVE_KEY_CONTEXT);
+  blake3_hash(out, material, material_len, context_key, DERIVE_KEY_MATERIAL);
+}
+
+/* BLAKE2sp */
+
+#define PARALLELISM 8
+
+static const uint8_t blake2s_sigma[10][16] = {
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+  {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+  {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+  {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+  {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+  {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+  {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+  {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+  {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+  {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+};
+
+static void blake2s_compress(uint32_t h[8], const uint8_t block[64],
+			     uint64_t counter, int last, int last_node) {
+  uint32_t m[16], v[16];
+  memcpy(m, block, 64);
+  memcpy(v, h, 32);
+  memcpy(v + 8, IV, 32);
+  v[12] ^= (uint32_t)counter;
+  v[13] ^= (uint32_t)(counter >> 32);
+  if (last) v[14] = ~v[14];
+  if (last_node) v[15] = ~v[15];
+  for (int r = 0; r < 10; r++) {
+    blake_round(v, m, blake2s_sigma[r]);
+  }
+  for (int i = 0; i < 8; i++) {
+    h[i] ^= v[i] ^ v[i + 8];
+  }
+}
+
+// The BLAKE2s parameter block for a 32-byte BLAKE2sp node, xored into the IV.
+static void blake2sp_init(uint32_t h[8], size_t key_len, uint32_t node_offset,
+			  uint32_t node_depth) {
+  memcpy(h, IV, 32);
+  h[0] ^= 32 | key_len << 8 | PARALLELISM << 16 | 2 << 24;
+  h[2] ^= node_offset;
+  h[3] ^= node_depth << 16 | 32 << 24;
+}
+
+void vector_blake2sp(uint8_t out[32], const uint8_t *in, size_t in_len,
+		     const uint8_t *key, size_t key_len) {
+  uint32_t h[PARALLELISM][8];
+  uint8_t block[64];
+  for (int i = 0; i < PARALLELISM; i++) {
+    blake2sp_init(h[i], key_len, i, 0);
+  }
+
+  // Leaf i hashes the padded key, then every 8th block of the input starting
+  // at block i. Whole stripes of 8 blocks go to the vector code while every
+  // leaf still has input after them, since a leaf's last block is flagged.
+  size_t stripes = in_len > 7 * 64 ? (in_len - 7 * 64 - 1) / (PARALLELISM * 64) : 0;
+  uint64_t counter = 0;
+  memset(block, 0, 64);
+  memcpy(block, key, key_len);
+  if (key_len > 0 && stripes > 0) {
+    uint8_t keys[PARALLELISM * 64];
+    for (int i = 0; i < PARALLELISM; i++) {
+      memcpy(keys + i * 64, block, 64);
+    }
+    blake2s_blocks(h, keys, PARALLELISM, 1, 0, 0);
+    counter = 64;
+  }
+  blake2s_blocks(h, in, PARALLELISM, stripes, PARALLELISM * 64, counter);
+  counter += stripes * 64;
+
+  uint8_t leaves[PARALLELISM * 32];
+  for (int i = 0; i < PARALLELISM; i++) {
+    uint64_t leaf_counter = counter;
+    size_t offset = stripes * PARALLELISM * 64 + i * 64;
+    int last_node = i == PARALLELISM - 1;
+    if (key_len > 0 && stripes == 0) {
+      int last = offset >= in_len;
+      leaf_counter += 64;
+      blake2s_compress(h[i], block, leaf_counter, last, last && last_node);
+    } else if (offset >= in_len && leaf_counter == 0) {
+      // An empty leaf without a key still compresses one empty block.
+      uint8_t empty[64];
+      memset(empty, 0, 64);
+      blake2s_compress(h[i], empty, 0, 1, last_node);
+    }
+    for (; offset < in_len; offset += PARALLELISM * 64) {
+      uint8_t leaf_block[64];
+      size_t block_len = in_len - offset < 64 ? in_len - offset : 64;
+      memset(leaf_block, 0, 64);
+      memcpy(leaf_block, in + offset, block_len);
+      leaf_counter += block_len;
+      int last = offset + PARALLELISM * 64 >= in_len;
+      blake2s_compress(h[i], leaf_block, leaf_counter, last, last && last_node);
+    }
+    memcpy(leaves + i * 32, h[i], 32);
+  }
+
+  uint32_t root[8];
+  blake2sp_init(root, key_len, 0, 1);
+  for (int i = 0; i < 4; i++) {
+    blake2s_compress(root, leaves + i * 64, (i + 1) * 64, i == 3, i == 3);
+  }
+  memcpy(out, root, 32);
+  memset(block, 0, 64);
+}
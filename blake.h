@@ -0,0 +1,54 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compression kernels from vchacha.S, one message per vector lane.
+
+// BLAKE3 chaining values of num_inputs whole inputs of blocks*64 bytes, back
+// to back, like hash_many in the BLAKE3 reference. flags holds the flags for
+// every block, with extra flags for the first block in bits 8-15 and for the
+// last block in bits 16-23. For parents out may be in.
+void vector_blake3_hash_many(uint8_t *out, const uint8_t *in,
+			     size_t num_inputs, size_t blocks,
+			     const uint32_t key[8], uint64_t counter,
+			     uint32_t increment_counter, uint32_t flags);
+// BLAKE2s of lanes independent states over whole blocks that are never the
+// last block of their message. Lane i reads its blocks from in + 64*i, stride
+// bytes apart, and counter is the bytes each lane has compressed so far.
+void vector_blake2s_blocks(uint32_t h[][8], const uint8_t *in, size_t lanes,
+			   size_t blocks, size_t stride, uint64_t counter);
+#ifdef __riscv_zvkb
+void vector_blake3_hash_many_zvkb(uint8_t *out, const uint8_t *in,
+				  size_t num_inputs, size_t blocks,
+				  const uint32_t key[8], uint64_t counter,
+				  uint32_t increment_counter, uint32_t flags);
+void vector_blake2s_blocks_zvkb(uint32_t h[][8], const uint8_t *in,
+				size_t lanes, size_t blocks, size_t stride,
+				uint64_t counter);
+#endif
+
+// 32-byte BLAKE3 hash, keyed hash and key derivation.
+void vector_blake3(uint8_t out[32], const uint8_t *in, size_t in_len);
+void vector_blake3_keyed(uint8_t out[32], const uint8_t *in, size_t in_len,
+			 const uint8_t key[32]);
+void vector_blake3_derive_key(uint8_t out[32], const char *context,
+			      const uint8_t *material, size_t material_len);
+
+// 32-byte BLAKE2sp, the 8-way parallel BLAKE2s tree mode, with a key of up
+// to 32 bytes, or none with key_len = 0.
+void vector_blake2sp(uint8_t out[32], const uint8_t *in, size_t in_len,
+		     const uint8_t *key, size_t key_len);
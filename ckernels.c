@@ -0,0 +1,189 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+// Portable C behind the kernel entry points that aead.c and lazymap.c call,
+// so they and their tests build and run on a host without RVV (host.sh).
+// ChaCha20 is BoringSSL's from boring.c, and Poly1305 is poly1305-donna's
+// 64-bit code behind OpenSSL's init, blocks and emit interface, like
+// vpoly.S. Nothing here is fast.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "boring.h"
+
+// Whole blocks only, like the kernel, and safe with out before in since
+// boring_chacha20 xors front to back.
+void vector_chacha20(uint8_t *out, const uint8_t *in, size_t in_len,
+		     const uint8_t key[32], const uint8_t nonce[12],
+		     uint32_t counter) {
+  boring_chacha20(out, in, in_len & ~63, key, nonce, counter);
+}
+
+void vector_chacha20_lanes(uint8_t *out, size_t blocks, const uint8_t key[32],
+			   const uint32_t counter_nonce[][4]) {
+  memset(out, 0, blocks * 64);
+  for (size_t i = 0; i < blocks; i++) {
+    boring_chacha20(out + 64 * i, out + 64 * i, 64, key,
+		    (const uint8_t *)&counter_nonce[i][1], counter_nonce[i][0]);
+  }
+}
+
+void vector_chacha20_keyed_lanes(uint8_t *out, size_t blocks,
+				 const uint32_t key_counter_nonce[][12]) {
+  memset(out, 0, blocks * 64);
+  for (size_t i = 0; i < blocks; i++) {
+    boring_chacha20(out + 64 * i, out + 64 * i, 64,
+		    (const uint8_t *)key_counter_nonce[i],
+		    (const uint8_t *)&key_counter_nonce[i][9],
+		    key_counter_nonce[i][8]);
+  }
+}
+
+void vector_chacha20_hp_masks(uint8_t masks[][5], size_t blocks,
+			      const uint8_t key[32],
+			      const uint8_t samples[][16]) {
+  for (size_t i = 0; i < blocks; i++) {
+    uint8_t block[64];
+    uint32_t counter;
+    memset(block, 0, 64);
+    memcpy(&counter, samples[i], 4);
+    boring_chacha20(block, block, 64, key, samples[i] + 4, counter);
+    memcpy(masks[i], block, 5);
+  }
+}
+
+void vector_xor(uint8_t *out, const uint8_t *in, const uint8_t *keystream,
+		size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    out[i] = in[i] ^ keystream[i];
+  }
+}
+
+// The accumulator and key in 44, 44 and 42-bit limbs.
+struct poly1305_donna {
+  uint64_t r[3];
+  uint64_t h[3];
+};
+
+static uint64_t load64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+void vector_poly1305_init(void *ctx, const unsigned char key[16]) {
+  struct poly1305_donna *st = ctx;
+  uint64_t t0 = load64(key);
+  uint64_t t1 = load64(key + 8);
+  st->r[0] = t0 & 0xffc0fffffff;
+  st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+  st->r[2] = (t1 >> 24) & 0x00ffffffc0f;
+  st->h[0] = st->h[1] = st->h[2] = 0;
+}
+
+void vector_poly1305_blocks(void *ctx, const unsigned char *inp, size_t len,
+			    uint32_t padbit) {
+  typedef unsigned __int128 u128;
+  struct poly1305_donna *st = ctx;
+  const uint64_t mask44 = 0xfffffffffff, mask42 = 0x3ffffffffff;
+  uint64_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2];
+  uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+  uint64_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2];
+  uint64_t hibit = (uint64_t)padbit << 40;
+  for (; len >= 16; inp += 16, len -= 16) {
+    uint64_t t0 = load64(inp);
+    uint64_t t1 = load64(inp + 8);
+    h0 += t0 & mask44;
+    h1 += ((t0 >> 44) | (t1 << 20)) & mask44;
+    h2 += (((t1 >> 24)) & mask42) | hibit;
+
+    u128 d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+    u128 d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+    u128 d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+    uint64_t c = (uint64_t)(d0 >> 44);
+    h0 = (uint64_t)d0 & mask44;
+    d1 += c;
+    c = (uint64_t)(d1 >> 44);
+    h1 = (uint64_t)d1 & mask44;
+    d2 += c;
+    c = (uint64_t)(d2 >> 42);
+    h2 = (uint64_t)d2 & mask42;
+    h0 += c * 5;
+    c = h0 >> 44;
+    h0 &= mask44;
+    h1 += c;
+  }
+  st->h[0] = h0;
+  st->h[1] = h1;
+  st->h[2] = h2;
+}
+
+void vector_poly1305_emit(void *ctx, unsigned char mac[16],
+			  const uint8_t nonce[16]) {
+  struct poly1305_donna *st = ctx;
+  const uint64_t mask44 = 0xfffffffffff, mask42 = 0x3ffffffffff;
+  uint64_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2];
+
+  // Fully carry h.
+  uint64_t c = h1 >> 44;
+  h1 &= mask44;
+  h2 += c;
+  c = h2 >> 42;
+  h2 &= mask42;
+  h0 += c * 5;
+  c = h0 >> 44;
+  h0 &= mask44;
+  h1 += c;
+  c = h1 >> 44;
+  h1 &= mask44;
+  h2 += c;
+  c = h2 >> 42;
+  h2 &= mask42;
+  h0 += c * 5;
+  c = h0 >> 44;
+  h0 &= mask44;
+  h1 += c;
+
+  // h - p, taken if it doesn't borrow.
+  uint64_t g0 = h0 + 5;
+  c = g0 >> 44;
+  g0 &= mask44;
+  uint64_t g1 = h1 + c;
+  c = g1 >> 44;
+  g1 &= mask44;
+  uint64_t g2 = h2 + c - ((uint64_t)1 << 42);
+  c = (g2 >> 63) - 1;
+  h0 = (h0 & ~c) | (g0 & c);
+  h1 = (h1 & ~c) | (g1 & c);
+  h2 = (h2 & ~c) | (g2 & c);
+
+  // h + s mod 2^128
+  uint64_t t0 = load64(nonce);
+  uint64_t t1 = load64(nonce + 8);
+  h0 += t0 & mask44;
+  c = h0 >> 44;
+  h0 &= mask44;
+  h1 += (((t0 >> 44) | (t1 << 20)) & mask44) + c;
+  c = h1 >> 44;
+  h1 &= mask44;
+  h2 += ((t1 >> 24) & mask42) + c;
+  h2 &= mask42;
+
+  h0 = h0 | (h1 << 44);
+  h1 = (h1 >> 20) | (h2 << 24);
+  memcpy(mac, &h0, 8);
+  memcpy(mac + 8, &h1, 8);
+}
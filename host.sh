@@ -0,0 +1,26 @@
+#!/bin/sh
+
+# Copyright 2020 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License") ;
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Builds the library code that doesn't need RVV (aead.c, arena.c, lazymap.c
+# and vcrypt) against the portable kernels in ckernels.c, and tests it on
+# the host, where system calls that qemu-user lacks, like userfaultfd, are
+# available.
+
+CC=${CC:-cc}
+$CC $CFLAGS vcrypt.c aead.c arena.c ckernels.c boring.c -o vcrypt_host -O -pthread &&
+    $CC $CFLAGS lazymap_test.c lazymap.c aead.c ckernels.c boring.c -o lazymap_test_host -O -pthread || exit 1
+
+./lazymap_test_host && ./vcrypt_test.sh ./vcrypt_host
@@ -0,0 +1,435 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include "intrinsics.h"
+
+#include <riscv_vector.h>
+#include <string.h>
+
+static uint32_t load32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static void store32(uint8_t *p, uint32_t v) {
+  memcpy(p, &v, 4);
+}
+
+#ifdef __riscv_zvkb
+#define ROTL(x, n) __riscv_vrol_vx_u32m1(x, n, vl)
+#else
+#define ROTL(x, n)							\
+  __riscv_vor_vv_u32m1(__riscv_vsll_vx_u32m1(x, n, vl),		\
+		       __riscv_vsrl_vx_u32m1(x, 32 - (n), vl), vl)
+#endif
+
+#define QUARTER_ROUND(a, b, c, d)				\
+  do {								\
+    a = __riscv_vadd_vv_u32m1(a, b, vl);			\
+    d = ROTL(__riscv_vxor_vv_u32m1(d, a, vl), 16);		\
+    c = __riscv_vadd_vv_u32m1(c, d, vl);			\
+    b = ROTL(__riscv_vxor_vv_u32m1(b, c, vl), 12);		\
+    a = __riscv_vadd_vv_u32m1(a, b, vl);			\
+    d = ROTL(__riscv_vxor_vv_u32m1(d, a, vl), 8);		\
+    c = __riscv_vadd_vv_u32m1(c, d, vl);			\
+    b = ROTL(__riscv_vxor_vv_u32m1(b, c, vl), 7);		\
+  } while (0)
+
+// Word i of every block in the batch, 64 bytes apart.
+#define LOAD_WORD(i)							\
+  vuint32m1_t m##i = __riscv_vlse32_v_u32m1((const uint32_t *)(in + 4 * i), \
+					    64, vl)
+#define STORE_WORD(i)							\
+  __riscv_vsse32_v_u32m1((uint32_t *)(out + 4 * i), 64,		\
+			 __riscv_vxor_vv_u32m1(x##i, m##i, vl), vl)
+
+// One block per lane, as in vchacha.S, with cell i of every block in x<i>.
+void intrinsic_chacha20(uint8_t *out, const uint8_t *in, size_t in_len,
+			const uint8_t key[32], const uint8_t nonce[12],
+			uint32_t counter) {
+  const uint32_t k0 = load32(key), k1 = load32(key + 4);
+  const uint32_t k2 = load32(key + 8), k3 = load32(key + 12);
+  const uint32_t k4 = load32(key + 16), k5 = load32(key + 20);
+  const uint32_t k6 = load32(key + 24), k7 = load32(key + 28);
+  const uint32_t n0 = load32(nonce), n1 = load32(nonce + 4);
+  const uint32_t n2 = load32(nonce + 8);
+
+  for (size_t blocks = in_len / 64; blocks > 0;) {
+    size_t vl = __riscv_vsetvl_e32m1(blocks);
+    vuint32m1_t ctr =
+      __riscv_vadd_vx_u32m1(__riscv_vid_v_u32m1(vl), counter, vl);
+    vuint32m1_t x0 = __riscv_vmv_v_x_u32m1(0x61707865, vl);
+    vuint32m1_t x1 = __riscv_vmv_v_x_u32m1(0x3320646e, vl);
+    vuint32m1_t x2 = __riscv_vmv_v_x_u32m1(0x79622d32, vl);
+    vuint32m1_t x3 = __riscv_vmv_v_x_u32m1(0x6b206574, vl);
+    vuint32m1_t x4 = __riscv_vmv_v_x_u32m1(k0, vl);
+    vuint32m1_t x5 = __riscv_vmv_v_x_u32m1(k1, vl);
+    vuint32m1_t x6 = __riscv_vmv_v_x_u32m1(k2, vl);
+    vuint32m1_t x7 = __riscv_vmv_v_x_u32m1(k3, vl);
+    vuint32m1_t x8 = __riscv_vmv_v_x_u32m1(k4, vl);
+    vuint32m1_t x9 = __riscv_vmv_v_x_u32m1(k5, vl);
+    vuint32m1_t x10 = __riscv_vmv_v_x_u32m1(k6, vl);
+    vuint32m1_t x11 = __riscv_vmv_v_x_u32m1(k7, vl);
+    vuint32m1_t x12 = ctr;
+    vuint32m1_t x13 = __riscv_vmv_v_x_u32m1(n0, vl);
+    vuint32m1_t x14 = __riscv_vmv_v_x_u32m1(n1, vl);
+    vuint32m1_t x15 = __riscv_vmv_v_x_u32m1(n2, vl);
+
+    for (int i = 0; i < 10; i++) {
+      QUARTER_ROUND(x0, x4, x8, x12);
+      QUARTER_ROUND(x1, x5, x9, x13);
+      QUARTER_ROUND(x2, x6, x10, x14);
+      QUARTER_ROUND(x3, x7, x11, x15);
+      QUARTER_ROUND(x0, x5, x10, x15);
+      QUARTER_ROUND(x1, x6, x11, x12);
+      QUARTER_ROUND(x2, x7, x8, x13);
+      QUARTER_ROUND(x3, x4, x9, x14);
+    }
+
+    x0 = __riscv_vadd_vx_u32m1(x0, 0x61707865, vl);
+    x1 = __riscv_vadd_vx_u32m1(x1, 0x3320646e, vl);
+    x2 = __riscv_vadd_vx_u32m1(x2, 0x79622d32, vl);
+    x3 = __riscv_vadd_vx_u32m1(x3, 0x6b206574, vl);
+    x4 = __riscv_vadd_vx_u32m1(x4, k0, vl);
+    x5 = __riscv_vadd_vx_u32m1(x5, k1, vl);
+    x6 = __riscv_vadd_vx_u32m1(x6, k2, vl);
+    x7 = __riscv_vadd_vx_u32m1(x7, k3, vl);
+    x8 = __riscv_vadd_vx_u32m1(x8, k4, vl);
+    x9 = __riscv_vadd_vx_u32m1(x9, k5, vl);
+    x10 = __riscv_vadd_vx_u32m1(x10, k6, vl);
+    x11 = __riscv_vadd_vx_u32m1(x11, k7, vl);
+    x12 = __riscv_vadd_vv_u32m1(x12, ctr, vl);
+    x13 = __riscv_vadd_vx_u32m1(x13, n0, vl);
+    x14 = __riscv_vadd_vx_u32m1(x14, n1, vl);
+    x15 = __riscv_vadd_vx_u32m1(x15, n2, vl);
+
+    // Load the whole batch before storing any of it, so out may be in or
+    // before it.
+    LOAD_WORD(0); LOAD_WORD(1); LOAD_WORD(2); LOAD_WORD(3);
+    LOAD_WORD(4); LOAD_WORD(5); LOAD_WORD(6); LOAD_WORD(7);
+    LOAD_WORD(8); LOAD_WORD(9); LOAD_WORD(10); LOAD_WORD(11);
+    LOAD_WORD(12); LOAD_WORD(13); LOAD_WORD(14); LOAD_WORD(15);
+    STORE_WORD(0); STORE_WORD(1); STORE_WORD(2); STORE_WORD(3);
+    STORE_WORD(4); STORE_WORD(5); STORE_WORD(6); STORE_WORD(7);
+    STORE_WORD(8); STORE_WORD(9); STORE_WORD(10); STORE_WORD(11);
+    STORE_WORD(12); STORE_WORD(13); STORE_WORD(14); STORE_WORD(15);
+
+    in += 64 * vl;
+    out += 64 * vl;
+    blocks -= vl;
+    counter += vl;
+  }
+}
+
+// The context is laid out like vpoly.S's, in 32-bit words: the accumulator in
+// 5 26-bit limbs, then the powers [r^max_vl, ..., r^2, r] in 5 limbs each,
+// with a flag at word 45 once the powers above r are filled in.
+#define LIMB_MASK 0x3ffffff
+#define POWERS 5
+#define CACHED_POWERS 45
+
+// The lanes multi_blocks uses, capped at 8 by the context.
+static size_t poly_max_vl() {
+  return __riscv_vsetvl_e32m1(8);
+}
+
+void intrinsic_poly1305_init(void *ctx, const unsigned char key[16]) {
+  uint32_t *state = ctx;
+  uint32_t *r = state + POWERS + 5 * (poly_max_vl() - 1);
+  r[0] = load32(key) & 0x3ffffff;
+  r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+  r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+  r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+  r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+  memset(state, 0, 20);
+  state[CACHED_POWERS] = 0;
+}
+
+// h = h * r with one carry pass, which leaves h[1] up to 2^26 + 2^10.
+static void poly_mul(uint32_t h[5], const uint32_t r[5]) {
+  uint32_t s1 = 5 * r[1], s2 = 5 * r[2], s3 = 5 * r[3], s4 = 5 * r[4];
+  uint64_t d0 = (uint64_t)h[0] * r[0] + (uint64_t)h[1] * s4 +
+    (uint64_t)h[2] * s3 + (uint64_t)h[3] * s2 + (uint64_t)h[4] * s1;
+  uint64_t d1 = (uint64_t)h[0] * r[1] + (uint64_t)h[1] * r[0] +
+    (uint64_t)h[2] * s4 + (uint64_t)h[3] * s3 + (uint64_t)h[4] * s2;
+  uint64_t d2 = (uint64_t)h[0] * r[2] + (uint64_t)h[1] * r[1] +
+    (uint64_t)h[2] * r[0] + (uint64_t)h[3] * s4 + (uint64_t)h[4] * s3;
+  uint64_t d3 = (uint64_t)h[0] * r[3] + (uint64_t)h[1] * r[2] +
+    (uint64_t)h[2] * r[1] + (uint64_t)h[3] * r[0] + (uint64_t)h[4] * s4;
+  uint64_t d4 = (uint64_t)h[0] * r[4] + (uint64_t)h[1] * r[3] +
+    (uint64_t)h[2] * r[2] + (uint64_t)h[3] * r[1] + (uint64_t)h[4] * r[0];
+  d1 += d0 >> 26;
+  d2 += d1 >> 26;
+  d3 += d2 >> 26;
+  d4 += d3 >> 26;
+  d0 = (d0 & LIMB_MASK) + 5 * (d4 >> 26);
+  h[0] = d0 & LIMB_MASK;
+  h[1] = (d1 & LIMB_MASK) + (d0 >> 26);
+  h[2] = d2 & LIMB_MASK;
+  h[3] = d3 & LIMB_MASK;
+  h[4] = d4 & LIMB_MASK;
+}
+
+static void poly_scalar_blocks(uint32_t h[5], const uint32_t r[5],
+			       const uint8_t *in, size_t blocks,
+			       uint32_t padbit) {
+  for (; blocks > 0; blocks--, in += 16) {
+    h[0] += load32(in) & LIMB_MASK;
+    h[1] += (load32(in + 3) >> 2) & LIMB_MASK;
+    h[2] += (load32(in + 6) >> 4) & LIMB_MASK;
+    h[3] += (load32(in + 9) >> 6) & LIMB_MASK;
+    h[4] += (load32(in + 12) >> 8) | (padbit << 24);
+    poly_mul(h, r);
+  }
+}
+
+// Fills in the powers of r from r^1 up, in scalar code, as they take only
+// max_vl - 1 multiplies once per key.
+static void poly_powers(uint32_t *state, size_t max_vl) {
+  uint32_t *powers = state + POWERS;
+  const uint32_t *r = powers + 5 * (max_vl - 1);
+  for (size_t i = max_vl - 1; i-- > 0;) {
+    memcpy(powers + 5 * i, powers + 5 * (i + 1), 20);
+    poly_mul(powers + 5 * i, r);
+  }
+  state[CACHED_POWERS] = 1;
+}
+
+// One vector block per lane, split into 5 26-bit limbs.
+static inline void poly_load_blocks(const uint8_t *in, uint32_t padbit,
+				    vuint32m1_t *m0, vuint32m1_t *m1,
+				    vuint32m1_t *m2, vuint32m1_t *m3,
+				    vuint32m1_t *m4, size_t vl) {
+  const uint32_t *words = (const uint32_t *)in;
+  vuint32m1_t w0 = __riscv_vlse32_v_u32m1(words, 16, vl);
+  vuint32m1_t w1 = __riscv_vlse32_v_u32m1(words + 1, 16, vl);
+  vuint32m1_t w2 = __riscv_vlse32_v_u32m1(words + 2, 16, vl);
+  vuint32m1_t w3 = __riscv_vlse32_v_u32m1(words + 3, 16, vl);
+  *m0 = __riscv_vand_vx_u32m1(w0, LIMB_MASK, vl);
+  *m1 = __riscv_vand_vx_u32m1(
+    __riscv_vor_vv_u32m1(__riscv_vsrl_vx_u32m1(w0, 26, vl),
+			 __riscv_vsll_vx_u32m1(w1, 6, vl), vl),
+    LIMB_MASK, vl);
+  *m2 = __riscv_vand_vx_u32m1(
+    __riscv_vor_vv_u32m1(__riscv_vsrl_vx_u32m1(w1, 20, vl),
+			 __riscv_vsll_vx_u32m1(w2, 12, vl), vl),
+    LIMB_MASK, vl);
+  *m3 = __riscv_vand_vx_u32m1(
+    __riscv_vor_vv_u32m1(__riscv_vsrl_vx_u32m1(w2, 14, vl),
+			 __riscv_vsll_vx_u32m1(w3, 18, vl), vl),
+    LIMB_MASK, vl);
+  *m4 = __riscv_vor_vx_u32m1(__riscv_vsrl_vx_u32m1(w3, 8, vl),
+			     padbit << 24, vl);
+}
+
+// Narrows the 64-bit column sums of a product back to 26-bit limbs with one
+// carry pass, like poly_mul.
+static inline void poly_carry(vuint64m2_t d0, vuint64m2_t d1, vuint64m2_t d2,
+			      vuint64m2_t d3, vuint64m2_t d4,
+			      vuint32m1_t *a0, vuint32m1_t *a1,
+			      vuint32m1_t *a2, vuint32m1_t *a3,
+			      vuint32m1_t *a4, size_t vl) {
+  d1 = __riscv_vadd_vv_u64m2(d1, __riscv_vsrl_vx_u64m2(d0, 26, vl), vl);
+  d2 = __riscv_vadd_vv_u64m2(d2, __riscv_vsrl_vx_u64m2(d1, 26, vl), vl);
+  d3 = __riscv_vadd_vv_u64m2(d3, __riscv_vsrl_vx_u64m2(d2, 26, vl), vl);
+  d4 = __riscv_vadd_vv_u64m2(d4, __riscv_vsrl_vx_u64m2(d3, 26, vl), vl);
+  d0 = __riscv_vmacc_vx_u64m2(__riscv_vand_vx_u64m2(d0, LIMB_MASK, vl), 5,
+			      __riscv_vsrl_vx_u64m2(d4, 26, vl), vl);
+  d1 = __riscv_vadd_vv_u64m2(__riscv_vand_vx_u64m2(d1, LIMB_MASK, vl),
+			     __riscv_vsrl_vx_u64m2(d0, 26, vl), vl);
+  *a0 = __riscv_vncvt_x_x_w_u32m1(__riscv_vand_vx_u64m2(d0, LIMB_MASK, vl), vl);
+  *a1 = __riscv_vncvt_x_x_w_u32m1(d1, vl);
+  *a2 = __riscv_vncvt_x_x_w_u32m1(__riscv_vand_vx_u64m2(d2, LIMB_MASK, vl), vl);
+  *a3 = __riscv_vncvt_x_x_w_u32m1(__riscv_vand_vx_u64m2(d3, LIMB_MASK, vl), vl);
+  *a4 = __riscv_vncvt_x_x_w_u32m1(__riscv_vand_vx_u64m2(d4, LIMB_MASK, vl), vl);
+}
+
+// a = a * r for the scalar r, in every lane.
+static inline void poly_mul_vx(vuint32m1_t *a0, vuint32m1_t *a1,
+			       vuint32m1_t *a2, vuint32m1_t *a3,
+			       vuint32m1_t *a4, const uint32_t r[5],
+			       size_t vl) {
+  uint32_t s1 = 5 * r[1], s2 = 5 * r[2], s3 = 5 * r[3], s4 = 5 * r[4];
+  vuint64m2_t d0 = __riscv_vwmulu_vx_u64m2(*a0, r[0], vl);
+  d0 = __riscv_vwmaccu_vx_u64m2(d0, s4, *a1, vl);
+  d0 = __riscv_vwmaccu_vx_u64m2(d0, s3, *a2, vl);
+  d0 = __riscv_vwmaccu_vx_u64m2(d0, s2, *a3, vl);
+  d0 = __riscv_vwmaccu_vx_u64m2(d0, s1, *a4, vl);
+  vuint64m2_t d1 = __riscv_vwmulu_vx_u64m2(*a0, r[1], vl);
+  d1 = __riscv_vwmaccu_vx_u64m2(d1, r[0], *a1, vl);
+  d1 = __riscv_vwmaccu_vx_u64m2(d1, s4, *a2, vl);
+  d1 = __riscv_vwmaccu_vx_u64m2(d1, s3, *a3, vl);
+  d1 = __riscv_vwmaccu_vx_u64m2(d1, s2, *a4, vl);
+  vuint64m2_t d2 = __riscv_vwmulu_vx_u64m2(*a0, r[2], vl);
+  d2 = __riscv_vwmaccu_vx_u64m2(d2, r[1], *a1, vl);
+  d2 = __riscv_vwmaccu_vx_u64m2(d2, r[0], *a2, vl);
+  d2 = __riscv_vwmaccu_vx_u64m2(d2, s4, *a3, vl);
+  d2 = __riscv_vwmaccu_vx_u64m2(d2, s3, *a4, vl);
+  vuint64m2_t d3 = __riscv_vwmulu_vx_u64m2(*a0, r[3], vl);
+  d3 = __riscv_vwmaccu_vx_u64m2(d3, r[2], *a1, vl);
+  d3 = __riscv_vwmaccu_vx_u64m2(d3, r[1], *a2, vl);
+  d3 = __riscv_vwmaccu_vx_u64m2(d3, r[0], *a3, vl);
+  d3 = __riscv_vwmaccu_vx_u64m2(d3, s4, *a4, vl);
+  vuint64m2_t d4 = __riscv_vwmulu_vx_u64m2(*a0, r[4], vl);
+  d4 = __riscv_vwmaccu_vx_u64m2(d4, r[3], *a1, vl);
+  d4 = __riscv_vwmaccu_vx_u64m2(d4, r[2], *a2, vl);
+  d4 = __riscv_vwmaccu_vx_u64m2(d4, r[1], *a3, vl);
+  d4 = __riscv_vwmaccu_vx_u64m2(d4, r[0], *a4, vl);
+  poly_carry(d0, d1, d2, d3, d4, a0, a1, a2, a3, a4, vl);
+}
+
+// a = a * [r^vl, ..., r^2, r], lane by lane.
+static inline void poly_mul_powers(vuint32m1_t *a0, vuint32m1_t *a1,
+				   vuint32m1_t *a2, vuint32m1_t *a3,
+				   vuint32m1_t *a4, const uint32_t *powers,
+				   size_t vl) {
+  vuint32m1_t r0 = __riscv_vlse32_v_u32m1(powers, 20, vl);
+  vuint32m1_t r1 = __riscv_vlse32_v_u32m1(powers + 1, 20, vl);
+  vuint32m1_t r2 = __riscv_vlse32_v_u32m1(powers + 2, 20, vl);
+  vuint32m1_t r3 = __riscv_vlse32_v_u32m1(powers + 3, 20, vl);
+  vuint32m1_t r4 = __riscv_vlse32_v_u32m1(powers + 4, 20, vl);
+  vuint32m1_t s1 = __riscv_vmul_vx_u32m1(r1, 5, vl);
+  vuint32m1_t s2 = __riscv_vmul_vx_u32m1(r2, 5, vl);
+  vuint32m1_t s3 = __riscv_vmul_vx_u32m1(r3, 5, vl);
+  vuint32m1_t s4 = __riscv_vmul_vx_u32m1(r4, 5, vl);
+  vuint64m2_t d0 = __riscv_vwmulu_vv_u64m2(*a0, r0, vl);
+  d0 = __riscv_vwmaccu_vv_u64m2(d0, s4, *a1, vl);
+  d0 = __riscv_vwmaccu_vv_u64m2(d0, s3, *a2, vl);
+  d0 = __riscv_vwmaccu_vv_u64m2(d0, s2, *a3, vl);
+  d0 = __riscv_vwmaccu_vv_u64m2(d0, s1, *a4, vl);
+  vuint64m2_t d1 = __riscv_vwmulu_vv_u64m2(*a0, r1, vl);
+  d1 = __riscv_vwmaccu_vv_u64m2(d1, r0, *a1, vl);
+  d1 = __riscv_vwmaccu_vv_u64m2(d1, s4, *a2, vl);
+  d1 = __riscv_vwmaccu_vv_u64m2(d1, s3, *a3, vl);
+  d1 = __riscv_vwmaccu_vv_u64m2(d1, s2, *a4, vl);
+  vuint64m2_t d2 = __riscv_vwmulu_vv_u64m2(*a0, r2, vl);
+  d2 = __riscv_vwmaccu_vv_u64m2(d2, r1, *a1, vl);
+  d2 = __riscv_vwmaccu_vv_u64m2(d2, r0, *a2, vl);
+  d2 = __riscv_vwmaccu_vv_u64m2(d2, s4, *a3, vl);
+  d2 = __riscv_vwmaccu_vv_u64m2(d2, s3, *a4, vl);
+  vuint64m2_t d3 = __riscv_vwmulu_vv_u64m2(*a0, r3, vl);
+  d3 = __riscv_vwmaccu_vv_u64m2(d3, r2, *a1, vl);
+  d3 = __riscv_vwmaccu_vv_u64m2(d3, r1, *a2, vl);
+  d3 = __riscv_vwmaccu_vv_u64m2(d3, r0, *a3, vl);
+  d3 = __riscv_vwmaccu_vv_u64m2(d3, s4, *a4, vl);
+  vuint64m2_t d4 = __riscv_vwmulu_vv_u64m2(*a0, r4, vl);
+  d4 = __riscv_vwmaccu_vv_u64m2(d4, r3, *a1, vl);
+  d4 = __riscv_vwmaccu_vv_u64m2(d4, r2, *a2, vl);
+  d4 = __riscv_vwmaccu_vv_u64m2(d4, r1, *a3, vl);
+  d4 = __riscv_vwmaccu_vv_u64m2(d4, r0, *a4, vl);
+  poly_carry(d0, d1, d2, d3, d4, a0, a1, a2, a3, a4, vl);
+}
+
+// Like multi_blocks: Horner's rule by r^vl down each lane, then each lane
+// times its power of r and the lanes summed. The blocks that don't fill a
+// vector go through the scalar loop first, so every batch is full and the
+// last block lines up with r^1.
+void intrinsic_poly1305_blocks(void *ctx, const unsigned char *inp,
+			       size_t len, uint32_t padbit) {
+  uint32_t *state = ctx;
+  const uint32_t *powers = state + POWERS;
+  size_t vl = poly_max_vl();
+  size_t blocks = len / 16;
+  size_t head = blocks % vl;
+  uint32_t h[5];
+  memcpy(h, state, 20);
+  poly_scalar_blocks(h, powers + 5 * (vl - 1), inp, head, padbit);
+  inp += 16 * head;
+  blocks -= head;
+
+  if (blocks > 0) {
+    if (!state[CACHED_POWERS]) {
+      poly_powers(state, vl);
+    }
+    vuint32m1_t a0, a1, a2, a3, a4, m0, m1, m2, m3, m4;
+    poly_load_blocks(inp, padbit, &a0, &a1, &a2, &a3, &a4, vl);
+    // The accumulator so far goes with the first block.
+    vbool32_t first =
+      __riscv_vmseq_vx_u32m1_b32(__riscv_vid_v_u32m1(vl), 0, vl);
+    a0 = __riscv_vadd_vx_u32m1_mu(first, a0, a0, h[0], vl);
+    a1 = __riscv_vadd_vx_u32m1_mu(first, a1, a1, h[1], vl);
+    a2 = __riscv_vadd_vx_u32m1_mu(first, a2, a2, h[2], vl);
+    a3 = __riscv_vadd_vx_u32m1_mu(first, a3, a3, h[3], vl);
+    a4 = __riscv_vadd_vx_u32m1_mu(first, a4, a4, h[4], vl);
+    for (inp += 16 * vl, blocks -= vl; blocks > 0;
+	 inp += 16 * vl, blocks -= vl) {
+      poly_mul_vx(&a0, &a1, &a2, &a3, &a4, powers, vl);
+      poly_load_blocks(inp, padbit, &m0, &m1, &m2, &m3, &m4, vl);
+      a0 = __riscv_vadd_vv_u32m1(a0, m0, vl);
+      a1 = __riscv_vadd_vv_u32m1(a1, m1, vl);
+      a2 = __riscv_vadd_vv_u32m1(a2, m2, vl);
+      a3 = __riscv_vadd_vv_u32m1(a3, m3, vl);
+      a4 = __riscv_vadd_vv_u32m1(a4, m4, vl);
+    }
+    poly_mul_powers(&a0, &a1, &a2, &a3, &a4, powers, vl);
+
+    // Each lane's limbs are below 2^27, so their sums fit in 32 bits.
+    vuint32m1_t zero = __riscv_vmv_v_x_u32m1(0, vl);
+    h[0] = __riscv_vmv_x_s_u32m1_u32(__riscv_vredsum_vs_u32m1_u32m1(a0, zero, vl));
+    h[1] = __riscv_vmv_x_s_u32m1_u32(__riscv_vredsum_vs_u32m1_u32m1(a1, zero, vl));
+    h[2] = __riscv_vmv_x_s_u32m1_u32(__riscv_vredsum_vs_u32m1_u32m1(a2, zero, vl));
+    h[3] = __riscv_vmv_x_s_u32m1_u32(__riscv_vredsum_vs_u32m1_u32m1(a3, zero, vl));
+    h[4] = __riscv_vmv_x_s_u32m1_u32(__riscv_vredsum_vs_u32m1_u32m1(a4, zero, vl));
+    h[1] += h[0] >> 26;
+    h[2] += h[1] >> 26;
+    h[3] += h[2] >> 26;
+    h[4] += h[3] >> 26;
+    h[0] = (h[0] & LIMB_MASK) + 5 * (h[4] >> 26);
+    h[1] = (h[1] & LIMB_MASK) + (h[0] >> 26);
+    h[0] &= LIMB_MASK;
+    h[2] &= LIMB_MASK;
+    h[3] &= LIMB_MASK;
+    h[4] &= LIMB_MASK;
+  }
+  memcpy(state, h, 20);
+}
+
+void intrinsic_poly1305_emit(void *ctx, unsigned char mac[16],
+			     const uint8_t nonce[16]) {
+  const uint32_t *state = ctx;
+  uint32_t h0 = state[0], h1 = state[1], h2 = state[2], h3 = state[3];
+  uint32_t h4 = state[4];
+
+  // Fully carry h, then subtract p if h >= p.
+  h1 += h0 >> 26; h0 &= LIMB_MASK;
+  h2 += h1 >> 26; h1 &= LIMB_MASK;
+  h3 += h2 >> 26; h2 &= LIMB_MASK;
+  h4 += h3 >> 26; h3 &= LIMB_MASK;
+  h0 += 5 * (h4 >> 26); h4 &= LIMB_MASK;
+  h1 += h0 >> 26; h0 &= LIMB_MASK;
+
+  uint32_t g0 = h0 + 5;
+  uint32_t g1 = h1 + (g0 >> 26); g0 &= LIMB_MASK;
+  uint32_t g2 = h2 + (g1 >> 26); g1 &= LIMB_MASK;
+  uint32_t g3 = h3 + (g2 >> 26); g2 &= LIMB_MASK;
+  uint32_t g4 = h4 + (g3 >> 26) - (1 << 26); g3 &= LIMB_MASK;
+  uint32_t use_g = (g4 >> 31) - 1;
+  h0 = (h0 & ~use_g) | (g0 & use_g);
+  h1 = (h1 & ~use_g) | (g1 & use_g);
+  h2 = (h2 & ~use_g) | (g2 & use_g);
+  h3 = (h3 & ~use_g) | (g3 & use_g);
+  h4 = (h4 & ~use_g) | (g4 & use_g);
+
+  // mac = h + s mod 2^128
+  uint64_t f = (uint64_t)(h0 | h1 << 26) + load32(nonce);
+  store32(mac, f);
+  f = (uint64_t)(h1 >> 6 | h2 << 20) + load32(nonce + 4) + (f >> 32);
+  store32(mac + 4, f);
+  f = (uint64_t)(h2 >> 12 | h3 << 14) + load32(nonce + 8) + (f >> 32);
+  store32(mac + 8, f);
+  f = (uint64_t)(h3 >> 18 | h4 << 8) + load32(nonce + 12) + (f >> 32);
+  store32(mac + 12, f);
+}
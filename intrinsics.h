@@ -0,0 +1,37 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ChaCha20 and Poly1305 written with the RVV C intrinsics, left to the
+// compiler to allocate and schedule. Each takes the same arguments and works
+// the same way as its counterpart in vchacha.S or vpoly.S, so they can be
+// swapped in for comparison, or used to try out a kernel idea before it is
+// written in assembly.
+
+// Like vector_chacha20: only whole 64-byte blocks, and out may be in or
+// before it.
+void intrinsic_chacha20(uint8_t *out, const uint8_t *in, size_t in_len,
+			const uint8_t key[32], const uint8_t nonce[12],
+			uint32_t counter);
+
+// Like vector_poly1305_init, _blocks and _emit, with the same context layout,
+// so any of them can be mixed with the assembly at a block boundary.
+void intrinsic_poly1305_init(void *ctx, const unsigned char key[16]);
+void intrinsic_poly1305_blocks(void *ctx, const unsigned char *inp,
+			       size_t len, uint32_t padbit);
+void intrinsic_poly1305_emit(void *ctx, unsigned char mac[16],
+			     const uint8_t nonce[16]);
@@ -0,0 +1,318 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include "lazymap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "aead.h"
+
+#ifdef __riscv_zvkb
+#define chacha20_lanes vector_chacha20_zvkb_lanes
+#else
+#define chacha20_lanes vector_chacha20_lanes
+#endif
+
+extern void chacha20_lanes(uint8_t *out, size_t blocks, const uint8_t key[32],
+			   const uint32_t counter_nonce[][4]);
+
+extern void vector_poly1305_init(void *ctx, const unsigned char key[16]);
+extern void vector_poly1305_blocks(void *ctx, const unsigned char *inp,
+				   size_t len, uint32_t padbit);
+extern void vector_poly1305_emit(void *ctx, unsigned char mac[16],
+				 const uint8_t nonce[16]);
+
+static size_t page_len(size_t len, size_t offset) {
+  return len - offset < LAZY_MAP_PAGE ? len - offset : LAZY_MAP_PAGE;
+}
+
+// The one-time Poly1305 keys of pages first to first + n - 1, one ChaCha20
+// block per vector lane, 64 bytes apart in keys.
+static void page_poly_keys(uint8_t *keys, size_t first, size_t n,
+			   const uint8_t key[32], const uint8_t nonce[12]) {
+  uint32_t counter_nonce[LAZY_MAP_MAX_READAHEAD][4];
+  for (size_t i = 0; i < n; i++) {
+    counter_nonce[i][0] = first + i;
+    memcpy(&counter_nonce[i][1], nonce, 12);
+    counter_nonce[i][3] ^= 0x80000000;  // the top bit of nonce[11]
+  }
+  chacha20_lanes(keys, n, key, counter_nonce);
+}
+
+// Plain Poly1305 over the page's ciphertext, no padding.
+static void page_tag(uint8_t tag[16], const uint8_t poly_key[32],
+		     const uint8_t *in, size_t len) {
+  double state[24];  // openssl's scratch space
+  vector_poly1305_init(&state, poly_key);
+  size_t block_len = len & ~15;
+  vector_poly1305_blocks(&state, in, block_len, 1);
+  if (len > block_len) {
+    size_t tail_len = len & 15;
+    uint8_t buffer[16];
+    memset(buffer, 0, 16);
+    memcpy(buffer, in + block_len, tail_len);
+    buffer[tail_len] = 1;
+    vector_poly1305_blocks(&state, buffer, 16, 0);
+  }
+  vector_poly1305_emit(&state, tag, poly_key + 16);
+}
+
+// constant time compare
+static int tags_equal(const uint8_t a[16], const uint8_t b[16]) {
+  uint8_t diff = 0;
+  for (int i = 0; i < 16; i++) {
+    diff |= a[i] ^ b[i];
+  }
+  return diff == 0;
+}
+
+void lazy_map_tags(uint8_t (*tags)[16], const uint8_t *ciphertext, size_t len,
+		   const uint8_t key[32], const uint8_t nonce[12]) {
+  uint8_t poly_keys[LAZY_MAP_MAX_READAHEAD * 64];
+  size_t num_pages = (len + LAZY_MAP_PAGE - 1) / LAZY_MAP_PAGE;
+  for (size_t first = 0; first < num_pages; first += LAZY_MAP_MAX_READAHEAD) {
+    size_t n = num_pages - first;
+    if (n > LAZY_MAP_MAX_READAHEAD) n = LAZY_MAP_MAX_READAHEAD;
+    page_poly_keys(poly_keys, first, n, key, nonce);
+    for (size_t i = 0; i < n; i++) {
+      size_t offset = (first + i) * LAZY_MAP_PAGE;
+      page_tag(tags[first + i], poly_keys + 64 * i, ciphertext + offset,
+	       page_len(len, offset));
+    }
+  }
+  memset(poly_keys, 0, sizeof(poly_keys));
+}
+
+static void wake(struct lazy_map *map, size_t page, size_t n) {
+  struct uffdio_range range = {(uintptr_t)map->data + page * LAZY_MAP_PAGE,
+			       n * LAZY_MAP_PAGE};
+  ioctl(map->uffd, UFFDIO_WAKE, &range);
+}
+
+// Fills the faulting page and the unmapped pages after it, up to
+// readahead, in one decrypt. Pages that fail their tag aren't copied in,
+// and the faulting page is made PROT_NONE instead, so the woken thread's
+// retry raises SIGSEGV.
+static void fill_pages(struct lazy_map *map, size_t page) {
+  if (map->mapped[page]) {
+    // A second thread faulted on the page before the copy woke the first.
+    wake(map, page, 1);
+    return;
+  }
+  size_t n = 1;
+  while (n < map->readahead && page + n < map->num_pages &&
+	 !map->mapped[page + n]) {
+    n++;
+  }
+  size_t offset = page * LAZY_MAP_PAGE;
+  size_t len = map->len - offset < n * LAZY_MAP_PAGE ?
+	       map->len - offset : n * LAZY_MAP_PAGE;
+
+  int ok[LAZY_MAP_MAX_READAHEAD];
+  for (size_t i = 0; i < n; i++) {
+    ok[i] = 1;
+  }
+  if (map->tags != NULL) {
+    uint8_t poly_keys[LAZY_MAP_MAX_READAHEAD * 64];
+    page_poly_keys(poly_keys, page, n, map->key, map->nonce);
+    for (size_t i = 0; i < n; i++) {
+      size_t page_offset = offset + i * LAZY_MAP_PAGE;
+      uint8_t tag[16];
+      page_tag(tag, poly_keys + 64 * i, map->ciphertext + page_offset,
+	       page_len(map->len, page_offset));
+      ok[i] = tags_equal(tag, map->tags[page + i]);
+      if (!ok[i]) {
+	__atomic_fetch_add(&map->pages_failed, 1, __ATOMIC_RELAXED);
+      }
+    }
+    memset(poly_keys, 0, sizeof(poly_keys));
+  }
+
+  // The run is decrypted whole, forged pages and all, so that it goes
+  // through the kernel in full vector batches. Only pages that verified
+  // leave the staging buffer.
+  vector_chacha20_at(map->staging, map->ciphertext + offset, len, map->key,
+		     map->nonce, offset);
+  memset(map->staging + len, 0, n * LAZY_MAP_PAGE - len);
+  for (size_t i = 0; i < n;) {
+    if (!ok[i]) {
+      i++;
+      continue;
+    }
+    size_t j = i + 1;
+    while (j < n && ok[j]) {
+      j++;
+    }
+    struct uffdio_copy copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.dst = (uintptr_t)map->data + (page + i) * LAZY_MAP_PAGE;
+    copy.src = (uintptr_t)map->staging + i * LAZY_MAP_PAGE;
+    copy.len = (j - i) * LAZY_MAP_PAGE;
+    copy.mode = UFFDIO_COPY_MODE_DONTWAKE;
+    if (ioctl(map->uffd, UFFDIO_COPY, &copy) == 0) {
+      memset(map->mapped + page + i, 1, j - i);
+      __atomic_fetch_add(&map->pages_mapped, j - i, __ATOMIC_RELAXED);
+    }
+    i = j;
+  }
+  if (!ok[0]) {
+    mprotect((void *)(map->data + offset), LAZY_MAP_PAGE, PROT_NONE);
+    map->mapped[page] = 1;
+  }
+  // One wake for the run, once the counters are up to date. A thread whose
+  // copy failed faults again.
+  wake(map, page, n);
+}
+
+static void *fault_thread(void *arg) {
+  struct lazy_map *map = arg;
+  struct pollfd fds[2] = {{map->uffd, POLLIN, 0}, {map->stop_fd, POLLIN, 0}};
+  for (;;) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) continue;
+      return NULL;
+    }
+    if (fds[1].revents != 0) {
+      return NULL;
+    }
+    struct uffd_msg msg;
+    if (read(map->uffd, &msg, sizeof(msg)) != sizeof(msg) ||
+	msg.event != UFFD_EVENT_PAGEFAULT) {
+      continue;
+    }
+    __atomic_fetch_add(&map->faults, 1, __ATOMIC_RELAXED);
+    fill_pages(map, (msg.arg.pagefault.address - (uintptr_t)map->data) /
+		    LAZY_MAP_PAGE);
+  }
+}
+
+static void release(struct lazy_map *map) {
+  if (map->uffd >= 0) close(map->uffd);
+  if (map->stop_fd >= 0) close(map->stop_fd);
+  if (map->data != NULL) {
+    munmap((void *)map->data, map->num_pages * LAZY_MAP_PAGE);
+  }
+  if (map->ciphertext != NULL) munmap((void *)map->ciphertext, map->len);
+  if (map->staging != NULL) {
+    memset(map->staging, 0, map->readahead * LAZY_MAP_PAGE);
+    free(map->staging);
+  }
+  free(map->mapped);
+  memset(map, 0, sizeof(*map));
+  map->uffd = -1;
+  map->stop_fd = -1;
+}
+
+int lazy_map_open(struct lazy_map *map, int fd, size_t len,
+		  const uint8_t key[32], const uint8_t nonce[12],
+		  const uint8_t (*tags)[16], size_t readahead) {
+  memset(map, 0, sizeof(*map));
+  map->uffd = -1;
+  map->stop_fd = -1;
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    return -1;
+  }
+  if (len == 0 || sysconf(_SC_PAGESIZE) != LAZY_MAP_PAGE) {
+    errno = EINVAL;
+    return -1;
+  }
+  // The tags only cover the pages that are there, so a file cut at a page
+  // boundary would verify, and a longer one would run off the end of them.
+  if ((uint64_t)st.st_size != len) {
+    errno = EBADMSG;
+    return -1;
+  }
+  // Where vector_chacha20_at's block counter wraps.
+  if ((uint64_t)len > (uint64_t)1 << 38) {
+    errno = EFBIG;
+    return -1;
+  }
+  if (readahead == 0) readahead = 1;
+  if (readahead > LAZY_MAP_MAX_READAHEAD) readahead = LAZY_MAP_MAX_READAHEAD;
+  map->len = len;
+  map->num_pages = (map->len + LAZY_MAP_PAGE - 1) / LAZY_MAP_PAGE;
+  map->readahead = readahead;
+  map->tags = tags;
+  memcpy(map->key, key, 32);
+  memcpy(map->nonce, nonce, 12);
+
+  void *p = mmap(NULL, map->len, PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) goto fail;
+  map->ciphertext = p;
+  p = mmap(NULL, map->num_pages * LAZY_MAP_PAGE, PROT_READ,
+	   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) goto fail;
+  map->data = p;
+  map->mapped = calloc(map->num_pages, 1);
+  map->staging = malloc(readahead * LAZY_MAP_PAGE);
+  if (map->mapped == NULL || map->staging == NULL) {
+    errno = ENOMEM;
+    goto fail;
+  }
+
+  // Faults from user space only, which needs no privilege from Linux 5.11
+  // on. Older kernels reject the flag.
+#ifdef UFFD_USER_MODE_ONLY
+  map->uffd = syscall(SYS_userfaultfd,
+		      O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+  if (map->uffd == -1 && errno == EINVAL)
+#endif
+  map->uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+  if (map->uffd == -1) goto fail;
+  struct uffdio_api api;
+  memset(&api, 0, sizeof(api));
+  api.api = UFFD_API;
+  if (ioctl(map->uffd, UFFDIO_API, &api) == -1) goto fail;
+  struct uffdio_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.range.start = (uintptr_t)map->data;
+  reg.range.len = map->num_pages * LAZY_MAP_PAGE;
+  reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+  if (ioctl(map->uffd, UFFDIO_REGISTER, &reg) == -1) goto fail;
+
+  map->stop_fd = eventfd(0, EFD_CLOEXEC);
+  if (map->stop_fd == -1) goto fail;
+  int err = pthread_create(&map->thread, NULL, fault_thread, map);
+  if (err != 0) {
+    errno = err;
+    goto fail;
+  }
+  return 0;
+
+fail:;
+  int saved = errno;
+  release(map);
+  errno = saved;
+  return -1;
+}
+
+void lazy_map_close(struct lazy_map *map) {
+  uint64_t one = 1;
+  if (write(map->stop_fd, &one, sizeof(one)) == sizeof(one)) {
+    pthread_join(map->thread, NULL);
+  }
+  release(map);
+}
@@ -0,0 +1,93 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// An encrypted file as a read-only mapping of its plaintext, decrypted a
+// page at a time on first access. The mapping starts out empty and
+// registered with userfaultfd, and a handler thread fills each page that
+// faults with vector_chacha20_at at the page's offset, so opening costs the
+// same for any file size and reading costs what is read.
+//
+// The file is the ChaCha20 keystream of key and nonce from counter 0 xored
+// with the plaintext, with no header. Pages may have Poly1305 tags, kept
+// apart from the file, from lazy_map_tags. Page i's one-time key is the
+// first 32 bytes of ChaCha20 block i under key and the nonce with the top
+// bit of its last byte flipped. Nothing here stops that nonce from being
+// used to encrypt something else under key, which would give away page
+// keys, so callers must never do so; picking every nonce with that bit
+// clear is enough. A page whose tag doesn't verify is made PROT_NONE, so
+// reading it raises SIGSEGV instead of returning forged plaintext. The
+// tags don't cover the file's length, so the caller passes it in.
+//
+// A fault also fills up to readahead - 1 following pages that aren't
+// mapped yet, decrypting them in one call and copying them in with one
+// UFFDIO_COPY, and computes their Poly1305 keys in one pass of the lanes
+// kernel.
+//
+// Unprivileged processes only get userfaultfd for faults from user space,
+// so a system call given a page of data that hasn't been read yet, like
+// write(fd, map->data, len), fails with EFAULT instead of filling it.
+
+#define LAZY_MAP_PAGE 4096
+#define LAZY_MAP_MAX_READAHEAD 64
+
+struct lazy_map {
+  const uint8_t *data;  // the plaintext, len bytes
+  size_t len;
+  // Counters, updated by the handler thread.
+  size_t pages_mapped;
+  size_t pages_failed;  // tags that didn't verify
+  size_t faults;
+  // Private to the map.
+  const uint8_t *ciphertext;
+  const uint8_t (*tags)[16];
+  uint8_t key[32];
+  uint8_t nonce[12];
+  size_t num_pages;
+  size_t readahead;
+  uint8_t *mapped;  // per page, 1 once filled or made PROT_NONE
+  uint8_t *staging;  // readahead pages, decrypted before the copy
+  int uffd;
+  int stop_fd;
+  pthread_t thread;
+};
+
+// Maps the file open on fd, which must be len bytes long. len comes from
+// wherever the tags do, not from the file. tags is NULL for a file without
+// them, and must otherwise hold (len + LAZY_MAP_PAGE - 1) / LAZY_MAP_PAGE
+// tags and stay valid until lazy_map_close. readahead is capped at
+// LAZY_MAP_MAX_READAHEAD, and 0 is taken as 1. Returns 0, or -1 with errno
+// set: EBADMSG if the file isn't len bytes, EINVAL if len is 0 or the page
+// size isn't LAZY_MAP_PAGE, or whatever userfaultfd failed with.
+int lazy_map_open(struct lazy_map *map, int fd, size_t len,
+		  const uint8_t key[32], const uint8_t nonce[12],
+		  const uint8_t (*tags)[16], size_t readahead);
+
+// Reads one of the map's counters, which the handler thread updates
+// before it wakes the faulting reader.
+static inline size_t lazy_map_count(const size_t *counter) {
+  return __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+}
+
+// Stops the handler and unmaps everything. No thread may be reading
+// map->data.
+void lazy_map_close(struct lazy_map *map);
+
+// The page tags of len bytes of ciphertext, for lazy_map_open.
+void lazy_map_tags(uint8_t (*tags)[16], const uint8_t *ciphertext, size_t len,
+		   const uint8_t key[32], const uint8_t nonce[12]);
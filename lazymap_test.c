@@ -0,0 +1,148 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+// Tests of the lazy map, built against the vector kernels by test.sh, where
+// qemu-user has no userfaultfd and they're skipped, and against the C
+// kernels by host.sh, where they run.
+
+#include <errno.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "boring.h"
+#include "lazymap.h"
+
+const char* pass_str = "\x1b[32mPASS\x1b[0m";
+const char* fail_str = "\x1b[31mFAIL\x1b[0m";
+
+sigjmp_buf fault_jump;
+
+void on_fault(int sig) {
+  (void)sig;
+  siglongjmp(fault_jump, 1);
+}
+
+// Whether reading p raises SIGSEGV.
+bool read_faults(const uint8_t* p) {
+  struct sigaction action, old_action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_fault;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &old_action);
+  volatile bool returned = false;
+  if (sigsetjmp(fault_jump, 1) == 0) {
+    (void)*(volatile const uint8_t*)p;
+    returned = true;
+  }
+  sigaction(SIGSEGV, &old_action, NULL);
+  return !returned;
+}
+
+// Ten pages and a partial one read through the lazy map, with readahead
+// filling the pages after a fault, then with one page's tag forged,
+// without tags, and cut short or grown.
+bool test_lazy_map(FILE* f) {
+  const size_t num_pages = 11;
+  const size_t len = 10*LAZY_MAP_PAGE + 100;
+  uint8_t key[32], nonce[12];
+  fread(key, 32, 1, f);
+  fread(nonce, 12, 1, f);
+  uint8_t* data = malloc(len);
+  uint8_t* ciphertext = malloc(len);
+  uint8_t (*tags)[16] = malloc(num_pages * 16);
+  fread(data, len, 1, f);
+  boring_chacha20(ciphertext, data, len, key, nonce, 0);
+  lazy_map_tags(tags, ciphertext, len, key, nonce);
+
+  // Page 10's tag from BoringSSL, keyed by block 10 of the flipped nonce.
+  uint8_t tag_nonce[12], poly_key[32], tag[16];
+  poly1305_state state;
+  memcpy(tag_nonce, nonce, 12);
+  tag_nonce[11] ^= 0x80;
+  memset(poly_key, 0, 32);
+  boring_chacha20(poly_key, poly_key, 32, key, tag_nonce, 10);
+  boring_poly1305_init(&state, poly_key);
+  boring_poly1305_update(&state, ciphertext + 10*LAZY_MAP_PAGE, 100);
+  boring_poly1305_finish(&state, tag);
+  bool pass = memcmp(tag, tags[10], 16) == 0;
+
+  FILE* file = tmpfile();
+  fwrite(ciphertext, len, 1, file);
+  fflush(file);
+  struct lazy_map map;
+  if (lazy_map_open(&map, fileno(file), len, key, nonce, (const uint8_t(*)[16])tags, 4) != 0) {
+    // qemu-user has no userfaultfd.
+    printf("lazy map skipped: %s\n", strerror(errno));
+  } else {
+    pass = pass && map.data[5000] == data[5000] && lazy_map_count(&map.pages_mapped) == 4;
+    pass = pass && memcmp(map.data, data, len) == 0;
+    pass = pass && lazy_map_count(&map.pages_mapped) == num_pages && lazy_map_count(&map.faults) == 4;
+    for (size_t i = len; i < num_pages*LAZY_MAP_PAGE; i++) {
+      pass = pass && map.data[i] == 0;
+    }
+    lazy_map_close(&map);
+
+    // Readahead from page 4 skips page 6, and leaves it to its own fault.
+    tags[6][0] ^= 1;
+    if (lazy_map_open(&map, fileno(file), len, key, nonce, (const uint8_t(*)[16])tags, 4) != 0) {
+      pass = false;
+    } else {
+      pass = pass && map.data[4*LAZY_MAP_PAGE] == data[4*LAZY_MAP_PAGE];
+      pass = pass && lazy_map_count(&map.pages_mapped) == 3 && lazy_map_count(&map.pages_failed) == 1;
+      pass = pass && memcmp(map.data + 4*LAZY_MAP_PAGE, data + 4*LAZY_MAP_PAGE, 2*LAZY_MAP_PAGE) == 0;
+      pass = pass && memcmp(map.data + 7*LAZY_MAP_PAGE, data + 7*LAZY_MAP_PAGE, LAZY_MAP_PAGE) == 0;
+      // Reading the forged page itself raises SIGSEGV and never returns.
+      pass = pass && read_faults(map.data + 6*LAZY_MAP_PAGE + 1);
+      pass = pass && lazy_map_count(&map.pages_failed) == 2 && lazy_map_count(&map.pages_mapped) == 3;
+      lazy_map_close(&map);
+    }
+
+    // No tags and no readahead, a fault per page.
+    if (lazy_map_open(&map, fileno(file), len, key, nonce, NULL, 1) != 0) {
+      pass = false;
+    } else {
+      pass = pass && memcmp(map.data, data, len) == 0 && lazy_map_count(&map.faults) == num_pages;
+      lazy_map_close(&map);
+    }
+  }
+
+  // The file cut to its whole pages, which all verify, and then grown by a
+  // page, is refused before userfaultfd comes into it.
+  FILE* cut = tmpfile();
+  fwrite(ciphertext, 10*LAZY_MAP_PAGE, 1, cut);
+  fflush(cut);
+  pass = pass && lazy_map_open(&map, fileno(cut), len, key, nonce, (const uint8_t(*)[16])tags, 4) == -1 && errno == EBADMSG;
+  pass = pass && ftruncate(fileno(cut), len + LAZY_MAP_PAGE) == 0;
+  pass = pass && lazy_map_open(&map, fileno(cut), len, key, nonce, (const uint8_t(*)[16])tags, 4) == -1 && errno == EBADMSG;
+  fclose(cut);
+  fclose(file);
+  free(data);
+  free(ciphertext);
+  free(tags);
+  return pass;
+}
+
+int main() {
+  FILE* rand = fopen("/dev/urandom", "r");
+  bool pass = test_lazy_map(rand);
+  fclose(rand);
+  printf("lazy map %s\n", pass ? pass_str : fail_str);
+  return pass ? 0 : 1;
+}
@@ -14,16 +14,27 @@
 
 #include <errno.h>
 #include <linux/perf_event.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/resource.h>
+#include <time.h>
 #include <unistd.h>
 #include "boring.h"
 #include "openssl.h"
+#include "secretbox.h"
+#include "blake.h"
+#include "aead.h"
+#include "arena.h"
+#include "batcher.h"
+#include "intrinsics.h"
+#include "stats.h"
+#include "lazymap.h"
 
 void println_hex(uint8_t* data, int size) {
   while (size > 0) {
@@ -40,59 +51,169 @@ void println_hex(uint8_t* data, int size) {
 
 extern uint32_t vlmax_u32();
 
+typedef void (*chacha_func)(uint8_t *out, const uint8_t *in, size_t in_len,
+			    const uint8_t key[32], const uint8_t nonce[12],
+			    uint32_t counter);
+
+extern void vector_chacha20(uint8_t *out, const uint8_t *in,
+			    size_t in_len, const uint8_t key[32],
+			    const uint8_t nonce[12], uint32_t counter);
+extern void vector_chacha20_pipelined(uint8_t *out, const uint8_t *in,
+				      size_t in_len, const uint8_t key[32],
+				      const uint8_t nonce[12], uint32_t counter);
+extern void vector_chacha20_m2(uint8_t *out, const uint8_t *in,
+			       size_t in_len, const uint8_t key[32],
+			       const uint8_t nonce[12], uint32_t counter);
+#ifdef __riscv_zvkb
+extern void vector_chacha20_zvkb(uint8_t *out, const uint8_t *in,
+				 size_t in_len, const uint8_t key[32],
+				 const uint8_t nonce[12], uint32_t counter);
+extern void vector_chacha20_zvkb_pipelined(uint8_t *out, const uint8_t *in,
+					   size_t in_len, const uint8_t key[32],
+					   const uint8_t nonce[12], uint32_t counter);
+extern void vector_chacha20_zvkb_m2(uint8_t *out, const uint8_t *in,
+				    size_t in_len, const uint8_t key[32],
+				    const uint8_t nonce[12], uint32_t counter);
+#endif
+
+// Every vector chacha variant, for the tests and benchmarks. All of them
+// work in place, and those with shifted_overlap also with out before in.
+const struct {
+  const char* name;
+  chacha_func func;
+  bool shifted_overlap;
+} chacha_impls[] = {
+  {"vector", vector_chacha20, true},
+  {"pipelined", vector_chacha20_pipelined, true},
+  {"m2", vector_chacha20_m2, false},
+#ifdef __riscv_zvkb
+  {"zvkb", vector_chacha20_zvkb, true},
+  {"zvkb pipelined", vector_chacha20_zvkb_pipelined, true},
+  {"zvkb m2", vector_chacha20_zvkb_m2, false},
+#endif
+  {"intrinsics", intrinsic_chacha20, true},
+};
+const int num_chacha_impls = sizeof(chacha_impls)/sizeof(chacha_impls[0]);
+
 const char* pass_str = "\x1b[32mPASS\x1b[0m";
 const char* fail_str = "\x1b[31mFAIL\x1b[0m";
 
+// Test and benchmark buffers come from a huge page arena, or from malloc
+// with -m, to see what the TLB costs.
+bool use_malloc = false;
+struct arena buffers;
+
+void* buffer_alloc(size_t len) {
+  void* p = use_malloc ? malloc(len) : arena_alloc(&buffers, len);
+  if (p == NULL && len > 0) {
+    fprintf(stderr, "Error allocating %zu bytes\n", len);
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+void buffer_free(void* p, size_t len) {
+  if (use_malloc) {
+    free(p);
+  } else {
+    arena_free(&buffers, p, len);
+  }
+}
+
 bool test_chacha(const uint8_t* data, size_t len, const uint8_t key[32], const uint8_t nonce[12], bool verbose) {
-  extern void vector_chacha20(uint8_t *out, const uint8_t *in,
-			      size_t in_len, const uint8_t key[32],
-			      const uint8_t nonce[12], uint32_t counter);
-#ifdef __riscv_zvkb
-  extern void vector_chacha20_zvkb(uint8_t *out, const uint8_t *in,
-			           size_t in_len, const uint8_t key[32],
-			           const uint8_t nonce[12], uint32_t counter);
-#endif
   len &= ~63;
-  uint8_t* golden = malloc(len);
+  uint8_t* golden = buffer_alloc(len);
   memset(golden, 0, len);
   boring_chacha20(golden, data, len, key, nonce, 0);
 
-  uint8_t* vector = malloc(len + 4);
-  memset(vector, 0, len+4);
-  vector_chacha20(vector, data, len, key, nonce, 0);
+  bool pass = true;
+  uint8_t* vector = buffer_alloc(len + 4);
+  for (int i = 0; i < num_chacha_impls; i++) {
+    memset(vector, 0, len+4);
+    chacha_impls[i].func(vector, data, len, key, nonce, 0);
 
-  uint8_t* vector_rotate = malloc(len+4);
-  memset(vector_rotate, 0, len+4);
-#ifdef __riscv_zvkb
-  vector_chacha20_zvkb(vector_rotate, data, len, key, nonce, 0);
-#endif
+    bool impl_pass = memcmp(golden, vector, len) == 0;
+    if (verbose || !impl_pass) {
+      printf("golden: ");
+      println_hex(golden, 32);
+      printf("%s: ", chacha_impls[i].name);
+      println_hex(vector, 32);
+    }
 
-  bool pass = memcmp(golden, vector, len) == 0 && memcmp(golden, vector_rotate, len) == 0;
+    uint32_t past_end = vector[len];
+    if (past_end != 0) {
+      printf("%s wrote past end %08x\n", chacha_impls[i].name, past_end);
+      impl_pass = false;
+    }
+    pass = pass && impl_pass;
+  }
 
-  if (verbose || !pass) {
-    printf("golden: ");
-    println_hex(golden, 32);
-    printf("vector: ");
-    println_hex(vector, 32);
-    printf("rotate: ");
-    println_hex(vector_rotate, 32);
+  buffer_free(golden, len);
+  buffer_free(vector, len + 4);
+
+  return pass;
+}
+
+// In place, and with out = in - shift as when stripping a header.
+bool test_chacha_overlap(const uint8_t* data, const uint8_t key[32], const uint8_t nonce[12]) {
+  const size_t lens[] = {64, 640, 4160, 64*1024 - 64};
+  const size_t shifts[] = {0, 1, 4, 13, 16, 32, 48, 63, 64, 65, 1000};
+  uint8_t* golden = malloc(64*1024);
+  uint8_t* buffer = malloc(64*1024 + 1000);
+  bool pass = true;
+  for (int l = 0; l < sizeof(lens)/sizeof(lens[0]); l++) {
+    size_t len = lens[l];
+    boring_chacha20(golden, data, len, key, nonce, 0);
+    for (int i = 0; i < num_chacha_impls; i++) {
+      for (int s = 0; s < sizeof(shifts)/sizeof(shifts[0]); s++) {
+	size_t shift = shifts[s];
+	if (shift > 0 && !chacha_impls[i].shifted_overlap) continue;
+	memcpy(buffer + shift, data, len);
+	chacha_impls[i].func(buffer, buffer + shift, len, key, nonce, 0);
+	if (memcmp(golden, buffer, len) != 0) {
+	  printf("%s overlap len=%zu shift=%zu\n", chacha_impls[i].name, len, shift);
+	  pass = false;
+	}
+      }
+    }
   }
+  free(golden);
+  free(buffer);
+  return pass;
+}
 
-  uint32_t past_end = vector[len];
-  if (past_end != 0) {
-    printf("vector wrote past end %08x\n", past_end);
-    pass = false;
+// Ranges at random offsets against the keystream from the start, and a
+// range near the top of the block counter.
+bool test_chacha_at(const uint8_t* data, FILE* f) {
+  const size_t len = 4096;
+  uint8_t key[32], nonce[12];
+  fread(key, 32, 1, f);
+  fread(nonce, 12, 1, f);
+  uint8_t* golden = malloc(len);
+  uint8_t* out = malloc(len + 1);
+  boring_chacha20(golden, data, len, key, nonce, 0);
+  bool pass = true;
+  for (int i = 0; i < 500 && pass; i++) {
+    uint16_t r[2];
+    fread(r, sizeof(r), 1, f);
+    size_t offset = r[0] % len;
+    size_t range = r[1] % (len - offset + 1);
+    out[range] = 0xaa;
+    vector_chacha20_at(out, data + offset, range, key, nonce, offset);
+    if (memcmp(out, golden + offset, range) != 0 || out[range] != 0xaa) {
+      printf("chacha at offset=%zu len=%zu\n", offset, range);
+      pass = false;
+    }
   }
-  past_end = vector_rotate[len];
-  if (past_end != 0) {
-    printf("vector w/ rotate wrote past end %08x\n", past_end);
+  const uint64_t far = ((uint64_t)0xfffffff0 << 6) + 13;
+  boring_chacha20(golden, data, 1024, key, nonce, far / 64);
+  vector_chacha20_at(out, data + 13, 1000, key, nonce, far);
+  if (pass && memcmp(out, golden + 13, 1000) != 0) {
+    printf("chacha at offset=%lu\n", far);
     pass = false;
   }
-
   free(golden);
-  free(vector);
-  free(vector_rotate);
-
+  free(out);
   return pass;
 }
 
@@ -110,6 +231,8 @@ bool test_chachas(FILE* f) {
   int counter = 0;
 
   bool pass = test_chacha(data, len, key, nonce, false);
+  pass = pass && test_chacha_overlap(data, key, nonce);
+  pass = pass && test_chacha_at(data, f);
 
   if (pass) {
     for (int i = 1, len = 1; len < 1000; len += i++) {
@@ -138,6 +261,10 @@ extern void vector_poly1305_multi_blocks(void *ctx, const unsigned char *inp,
 		  size_t len, uint32_t padbit);
 extern void vector_poly1305_single_blocks(void *ctx, const unsigned char *inp,
 		  size_t len, uint32_t padbit);
+extern void vector_poly1305_scalar_blocks(void *ctx, const unsigned char *inp,
+		  size_t len, uint32_t padbit);
+extern void vector_poly1305_blocks44(void *ctx, const unsigned char *inp,
+		  size_t len, uint32_t padbit);
 extern void vector_poly1305_emit(void *ctx, unsigned char mac[16],
 		  const uint8_t nonce[16]);
 
@@ -159,6 +286,24 @@ void vector_poly1305(const uint8_t* in, size_t len,
   vector_poly1305_emit(&state, sig, key+16);
 }
 
+// vector_poly1305 with the intrinsics engine throughout.
+void intrinsic_poly1305(const uint8_t* in, size_t len,
+			const uint8_t key[32], uint8_t sig[16]) {
+  double state[24];
+  intrinsic_poly1305_init(&state, key);
+  size_t block_len = len &~ 15;
+  intrinsic_poly1305_blocks(&state, in, block_len, 1);
+  if (len > block_len) {
+    size_t tail_len = len & 15;
+    uint8_t buffer[16];
+    memset(buffer, 0, 16);
+    memcpy(buffer, in+block_len, tail_len);
+    buffer[tail_len] = 1;
+    intrinsic_poly1305_blocks(&state, buffer, 16, 0);
+  }
+  intrinsic_poly1305_emit(&state, sig, key+16);
+}
+
 bool test_poly(const uint8_t* data, size_t len, const uint8_t key[32], bool verbose) {
   poly1305_state state;
   uint8_t sig[16];
@@ -169,13 +314,37 @@ bool test_poly(const uint8_t* data, size_t len, const uint8_t key[32], bool verb
   uint8_t sig2[16];
   vector_poly1305(data, len, key, sig2, vector_poly1305_blocks);
 
-  bool pass = memcmp(sig, sig2, 16) == 0;
+  uint8_t sig3[16];
+  vector_poly1305(data, len, key, sig3, vector_poly1305_scalar_blocks);
+
+  uint8_t sig4[16];
+  vector_poly1305(data, len, key, sig4, vector_poly1305_blocks44);
+
+  uint8_t sig5[16];
+  intrinsic_poly1305(data, len, key, sig5);
+
+  // The intrinsics blocks between the assembly's init and emit, to check
+  // that they agree on the context.
+  uint8_t sig6[16];
+  vector_poly1305(data, len, key, sig6, intrinsic_poly1305_blocks);
+
+  bool pass = memcmp(sig, sig2, 16) == 0 && memcmp(sig, sig3, 16) == 0 &&
+    memcmp(sig, sig4, 16) == 0 && memcmp(sig, sig5, 16) == 0 &&
+    memcmp(sig, sig6, 16) == 0;
 
   if (verbose || !pass) {
     printf("boring mac: ");
     println_hex(sig, 16);
     printf("vector mac: ");
     println_hex(sig2, 16);
+    printf("scalar mac: ");
+    println_hex(sig3, 16);
+    printf("radix 2^44 mac: ");
+    println_hex(sig4, 16);
+    printf("intrinsics mac: ");
+    println_hex(sig5, 16);
+    printf("mixed mac: ");
+    println_hex(sig6, 16);
   }
 
   return pass;
@@ -190,6 +359,7 @@ bool test_polys(FILE* f) {
   			   0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
   const uint8_t data[272] = "Setec astronomy;too many secrets";
   // Test with all bits set in inputs to trigger as many carries as possible.
+  // This is long enough to run through the deferred carries in lazy_loop.
   bool pass = test_poly(max_bits, big_len, max_bits, false);
 
   if (pass) {
@@ -217,7 +387,726 @@ bool test_polys(FILE* f) {
   return pass;
 }
 
-void run_benchmarks(size_t input_size, size_t num_runs) {
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+// Plain C Salsa20 block function as a reference for the vector code.
+void ref_salsa20_block(uint8_t out[64], const uint8_t key[32],
+		       const uint8_t nonce[8], uint64_t counter) {
+  uint32_t x[16];
+  const uint8_t* sigma = (const uint8_t*)"expand 32-byte k";
+  uint8_t input[64];
+  memcpy(input, sigma, 4);
+  memcpy(input+4, key, 16);
+  memcpy(input+20, sigma+4, 4);
+  memcpy(input+24, nonce, 8);
+  for (int i = 0; i < 8; i++) input[32+i] = counter >> (8*i);
+  memcpy(input+40, sigma+8, 4);
+  memcpy(input+44, key+16, 16);
+  memcpy(input+60, sigma+12, 4);
+  memcpy(x, input, 64);
+  static const int qr[8][4] = {
+    {0, 4, 8, 12}, {5, 9, 13, 1}, {10, 14, 2, 6}, {15, 3, 7, 11},  // columns
+    {0, 1, 2, 3}, {5, 6, 7, 4}, {10, 11, 8, 9}, {15, 12, 13, 14},  // rows
+  };
+  for (int i = 0; i < 10; i++) {
+    for (int j = 0; j < 8; j++) {
+      int a = qr[j][0], b = qr[j][1], c = qr[j][2], d = qr[j][3];
+      x[b] ^= ROTL32(x[a] + x[d], 7);
+      x[c] ^= ROTL32(x[b] + x[a], 9);
+      x[d] ^= ROTL32(x[c] + x[b], 13);
+      x[a] ^= ROTL32(x[d] + x[c], 18);
+    }
+  }
+  uint32_t in32[16];
+  memcpy(in32, input, 64);
+  for (int i = 0; i < 16; i++) x[i] += in32[i];
+  memcpy(out, x, 64);
+}
+
+bool test_salsa(const uint8_t* data, size_t len, const uint8_t key[32],
+		const uint8_t nonce[8], uint64_t counter) {
+  len &= ~63;
+  uint8_t* golden = malloc(len);
+  for (size_t i = 0; i < len; i += 64) {
+    ref_salsa20_block(golden+i, key, nonce, counter + i/64);
+    for (int j = 0; j < 64; j++) golden[i+j] ^= data[i+j];
+  }
+
+  bool pass = true;
+  uint8_t* vector = malloc(len + 4);
+  memset(vector, 0, len+4);
+  vector_salsa20(vector, data, len, key, nonce, counter);
+  pass = pass && memcmp(golden, vector, len) == 0 && vector[len] == 0;
+#ifdef __riscv_zvkb
+  memset(vector, 0, len+4);
+  vector_salsa20_zvkb(vector, data, len, key, nonce, counter);
+  pass = pass && memcmp(golden, vector, len) == 0 && vector[len] == 0;
+#endif
+
+  free(golden);
+  free(vector);
+  return pass;
+}
+
+void parse_hex(uint8_t* out, const char* hex, int size) {
+  for (int i = 0; i < size; i++) {
+    sscanf(hex + 2*i, "%2hhx", &out[i]);
+  }
+}
+
+// The XSalsa20-Poly1305 test vector from NaCl's tests/secretbox.c.
+bool test_secretbox() {
+  uint8_t key[32], nonce[24], m[131], golden[147], box[147], opened[131];
+  uint8_t firstkey[32], shared[32], zero[16], subkey[32];
+  parse_hex(shared, "4a5d9d5ba4ce2de1728e3bf480350f25"
+	    "e07e21c947d19e3376f09b3c1e161742", 32);
+  parse_hex(firstkey, "1b27556473e985d462cd51197a9a46c7"
+	    "6009549eac6474f206c4ee0844f68389", 32);
+  parse_hex(nonce, "69696ee955b62b73cd62bda875fc73d6"
+	    "8219e0036b7a0b37", 24);
+  parse_hex(m, "be075fc53c81f2d5cf141316ebeb0c7b5228c52a4c62cbd44b66849b64244ffc"
+	    "e5ecbaaf33bd751a1ac728d45e6c61296cdc3c01233561f41db66cce314adb31"
+	    "0e3be8250c46f06dceea3a7fa1348057e2f6556ad6b1318a024a838f21af1fde"
+	    "048977eb48f59ffd4924ca1c60902e52f0a089bc76897040e082f93776384864"
+	    "5e0705", 131);
+  parse_hex(golden, "f3ffc7703f9400e52a7dfb4b3d3305d98e993b9f48681273c29650ba32fc76ce"
+	    "48332ea7164d96a4476fb8c531a1186ac0dfc17c98dce87b4da7f011ec48c972"
+	    "71d2c20f9b928fe2270d6fb863d51738b48eeee314a7cc8ab932164548e526ae"
+	    "90224368517acfeabd6bb3732bc0e9da99832b61ca01b6de56244a9e88d5f9b3"
+	    "7973f622a43d14a6599b1f654cb45a74e355a5", 147);
+  memset(zero, 0, 16);
+
+  vector_hsalsa20(subkey, shared, zero);
+  bool pass = memcmp(subkey, firstkey, 32) == 0;
+#ifdef __riscv_zvkb
+  vector_hsalsa20_zvkb(subkey, shared, zero);
+  pass = pass && memcmp(subkey, firstkey, 32) == 0;
+#endif
+
+  memcpy(key, firstkey, 32);
+  vector_secretbox_easy(box, m, sizeof(m), nonce, key);
+  if (memcmp(box, golden, sizeof(box)) != 0) {
+    printf("golden: ");
+    println_hex(golden, 32);
+    printf("vector: ");
+    println_hex(box, 32);
+    pass = false;
+  }
+  if (vector_secretbox_open_easy(opened, box, sizeof(box), nonce, key) != 0 ||
+      memcmp(opened, m, sizeof(m)) != 0) {
+    printf("secretbox open failed\n");
+    pass = false;
+  }
+  box[sizeof(box)-1] ^= 1;
+  if (vector_secretbox_open_easy(opened, box, sizeof(box), nonce, key) == 0) {
+    printf("secretbox open accepted a forgery\n");
+    pass = false;
+  }
+  return pass;
+}
+
+bool test_salsas(FILE* f) {
+  int len = 16*1024;
+  uint8_t* data = malloc(len);
+  fread(data, len, 1, f);
+  uint8_t key[32];
+  uint8_t nonce[8];
+  fread(key, 32, 1, f);
+  fread(nonce, 8, 1, f);
+
+  // The counter is 64 bits, so cross the 32 bit boundary too.
+  bool pass = test_salsa(data, len, key, nonce, 0) &&
+    test_salsa(data, len, key, nonce, 0xfffffff0ull) &&
+    test_secretbox();
+
+  if (pass) {
+    for (int i = 1, len = 1; len < 1000; len += i++) {
+      fread(key, 32, 1, f);
+      fread(nonce, 8, 1, f);
+      if (!test_salsa(data, len, key, nonce, len)) {
+	printf("Failed with len=%d\n", len);
+	pass = false;
+	break;
+      }
+    }
+  }
+
+  if (pass) {
+    printf("VLEN=%d salsa  %s\n", vlmax_u32()*32, pass_str);
+  } else {
+    printf("VLEN=%d salsa  %s\n", vlmax_u32()*32, fail_str);
+  }
+  free(data);
+  return pass;
+}
+
+// Input bytes i % 251, as in the BLAKE3 test vectors, with expected digests
+// from the BLAKE3 and BLAKE2 reference implementations.
+struct blake_vector {
+  const char* name;
+  size_t len;
+  int key;  // 0: none, 1: "Setec astronomy...", 2: bytes 0-31 (BLAKE2 KAT key)
+  const char* digest;
+};
+
+const struct blake_vector blake_vectors[] = {
+  {"blake3", 0, 0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+  {"blake3", 1025, 0, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+  {"blake3", 31744, 0, "62b6960e1a44bcc1eb1a611a8d6235b6b4b78f32e7abc4fb4c6cdcce94895c47"},
+  {"blake3 keyed", 8193, 1, "e20f206284ea9db63cfe5170afb216a113219f27a6591aac8961c5a2ea8d2b46"},
+  {"blake3 derive", 3073, 0, "72613c9ec9ff7e40f8f5c173784c532ad852e827dba2bf85b2ab4b76f7079081"},
+  {"blake2sp", 0, 0, "dd0e891776933f43c7d032b08a917e25741f8aa9a12c12e1cac8801500f2ca4f"},
+  {"blake2sp", 961, 0, "b503bdd1b5809c875985eea1647789fc470c7c72551f1f0fac9e8373c8b57164"},
+  {"blake2sp", 102400, 0, "9b190ddcc724195a17f7db06e80f7c2944dc0fdaf30c29edcf3bee47a8f3d61b"},
+  {"blake2sp", 0, 2, "715cb13895aeb678f6124160bff21465b30f4f6874193fc851b4621043f09cc6"},
+  {"blake2sp", 8193, 1, "4e2fe0cb780d1c620b62a5be23f1d7b4fc5d8e7d64a4ee8caef6f3411cfd7a9a"},
+};
+const int num_blake_vectors = sizeof(blake_vectors)/sizeof(blake_vectors[0]);
+
+bool test_blakes(FILE* f) {
+  const int max_len = 102400;
+  uint8_t* data = malloc(max_len);
+  for (int i = 0; i < max_len; i++) {
+    data[i] = i % 251;
+  }
+  uint8_t keys[3][32] = {{0}, "Setec astronomy;too many secrets"};
+  for (int i = 0; i < 32; i++) {
+    keys[2][i] = i;
+  }
+
+  bool pass = true;
+  for (int i = 0; i < num_blake_vectors; i++) {
+    const struct blake_vector* v = &blake_vectors[i];
+    uint8_t golden[32], digest[32];
+    parse_hex(golden, v->digest, 32);
+    if (strcmp(v->name, "blake2sp") == 0) {
+      vector_blake2sp(digest, data, v->len, keys[v->key], v->key ? 32 : 0);
+    } else if (strcmp(v->name, "blake3 derive") == 0) {
+      vector_blake3_derive_key(digest,
+	  "BLAKE3 2019-12-27 16:29:52 test vectors context", data, v->len);
+    } else if (v->key) {
+      vector_blake3_keyed(digest, data, v->len, keys[v->key]);
+    } else {
+      vector_blake3(digest, data, v->len);
+    }
+    if (memcmp(golden, digest, 32) != 0) {
+      printf("%s len=%zu\ngolden: ", v->name, v->len);
+      println_hex(golden, 32);
+      printf("vector: ");
+      println_hex(digest, 32);
+      pass = false;
+    }
+  }
+
+#ifdef __riscv_zvkb
+  // The hashes above use the Zvkb kernels, so check the others against them.
+  fread(data, 64*1024, 1, f);
+  uint32_t key[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  uint8_t cv[64*32], cv_zvkb[64*32];
+  vector_blake3_hash_many(cv, data, 64, 16, key, 0xfffffffc, 1, 1 << 8 | 2 << 16);
+  vector_blake3_hash_many_zvkb(cv_zvkb, data, 64, 16, key, 0xfffffffc, 1, 1 << 8 | 2 << 16);
+  pass = pass && memcmp(cv, cv_zvkb, sizeof(cv)) == 0;
+  uint32_t h[8][8], h_zvkb[8][8];
+  memset(h, 0x5a, sizeof(h));
+  memset(h_zvkb, 0x5a, sizeof(h_zvkb));
+  vector_blake2s_blocks(h, data, 8, 16, 512, 64);
+  vector_blake2s_blocks_zvkb(h_zvkb, data, 8, 16, 512, 64);
+  pass = pass && memcmp(h, h_zvkb, sizeof(h)) == 0;
+#endif
+
+  if (pass) {
+    printf("VLEN=%d blake  %s\n", vlmax_u32()*32, pass_str);
+  } else {
+    printf("VLEN=%d blake  %s\n", vlmax_u32()*32, fail_str);
+  }
+  free(data);
+  return pass;
+}
+
+// The AEAD built from the BoringSSL ChaCha20 and Poly1305.
+void boring_chacha20_poly1305_seal(uint8_t* out, const uint8_t* in, size_t len,
+				   const uint8_t* ad, size_t ad_len,
+				   const uint8_t nonce[12], const uint8_t key[32]) {
+  uint8_t poly_key[32], lengths[16];
+  const uint8_t zeros[16] = {0};
+  memset(poly_key, 0, 32);
+  boring_chacha20(poly_key, poly_key, 32, key, nonce, 0);
+  boring_chacha20(out, in, len, key, nonce, 1);
+  poly1305_state state;
+  boring_poly1305_init(&state, poly_key);
+  boring_poly1305_update(&state, ad, ad_len);
+  boring_poly1305_update(&state, zeros, (16 - ad_len % 16) % 16);
+  boring_poly1305_update(&state, out, len);
+  boring_poly1305_update(&state, zeros, (16 - len % 16) % 16);
+  for (int i = 0; i < 8; i++) {
+    lengths[i] = (uint64_t)ad_len >> (8*i);
+    lengths[8+i] = (uint64_t)len >> (8*i);
+  }
+  boring_poly1305_update(&state, lengths, 16);
+  boring_poly1305_finish(&state, out + len);
+}
+
+bool test_aead(const uint8_t* data, size_t len, const uint8_t* ad, size_t ad_len,
+	       const uint8_t key[32], const uint8_t nonce[12]) {
+  uint8_t* golden = malloc(len + 16);
+  uint8_t* sealed = malloc(len + 16);
+  uint8_t* opened = malloc(len + 16);
+  boring_chacha20_poly1305_seal(golden, data, len, ad, ad_len, nonce, key);
+  vector_chacha20_poly1305_seal(sealed, data, len, ad, ad_len, nonce, key);
+  bool pass = memcmp(golden, sealed, len + 16) == 0;
+
+  pass = pass && vector_chacha20_poly1305_open(opened, sealed, len + 16, ad, ad_len, nonce, key) == 0 &&
+    memcmp(opened, data, len) == 0;
+  memcpy(opened, sealed, len + 16);
+  pass = pass && vector_chacha20_poly1305_open_stream(opened, opened, len + 16, ad, ad_len, nonce, key) == 0 &&
+    memcmp(opened, data, len) == 0;
+
+  // A forgery must not be decrypted, and open must leave out alone.
+  sealed[len] ^= 1;
+  memset(opened, 0xaa, len);
+  pass = pass && vector_chacha20_poly1305_open(opened, sealed, len + 16, ad, ad_len, nonce, key) == -1;
+  for (size_t i = 0; i < len; i++) {
+    if (opened[i] != 0xaa) {
+      printf("open wrote a forgery\n");
+      pass = false;
+      break;
+    }
+  }
+  pass = pass && vector_chacha20_poly1305_open_stream(opened, sealed, len + 16, ad, ad_len, nonce, key) == -1;
+
+  free(golden);
+  free(sealed);
+  free(opened);
+  return pass;
+}
+
+// Seal and open with out = in - shift, against separate buffers.
+bool test_aead_overlap(const uint8_t* data, size_t len, const uint8_t* ad, size_t ad_len,
+		       const uint8_t key[32], const uint8_t nonce[12]) {
+  const size_t shifts[] = {0, 1, 5, 13, 29, 64, 1000};
+  uint8_t* sealed = malloc(len + 16);
+  uint8_t* buffer = malloc(len + 16 + 1000);
+  vector_chacha20_poly1305_seal(sealed, data, len, ad, ad_len, nonce, key);
+  bool pass = true;
+  for (int s = 0; s < sizeof(shifts)/sizeof(shifts[0]) && pass; s++) {
+    size_t shift = shifts[s];
+    memcpy(buffer + shift, data, len);
+    vector_chacha20_poly1305_seal(buffer, buffer + shift, len, ad, ad_len, nonce, key);
+    pass = memcmp(sealed, buffer, len + 16) == 0;
+    memcpy(buffer + shift, sealed, len + 16);
+    pass = pass && vector_chacha20_poly1305_open(buffer, buffer + shift, len + 16, ad, ad_len, nonce, key) == 0;
+    pass = pass && memcmp(data, buffer, len) == 0;
+    memcpy(buffer + shift, sealed, len + 16);
+    pass = pass && vector_chacha20_poly1305_open_stream(buffer, buffer + shift, len + 16, ad, ad_len, nonce, key) == 0;
+    pass = pass && memcmp(data, buffer, len) == 0;
+    if (!pass) {
+      printf("aead overlap len=%zu shift=%zu\n", len, shift);
+    }
+  }
+  free(sealed);
+  free(buffer);
+  return pass;
+}
+
+void tls13_nonce(uint8_t nonce[12], const uint8_t iv[12], uint64_t seq) {
+  memcpy(nonce, iv, 12);
+  for (int i = 0; i < 8; i++) {
+    nonce[4+i] ^= seq >> (56 - 8*i);
+  }
+}
+
+// Batches of mixed length records, against one record at a time.
+bool test_tls13_records(FILE* f) {
+  const int num_records = 100;
+  struct tls_record records[num_records];
+  uint8_t* plaintext[num_records];
+  uint8_t* sealed[num_records];
+  size_t lens[num_records];
+  uint8_t header[5] = {23, 3, 3, 0, 0};
+  uint8_t key[32], iv[12], nonce[12];
+  fread(key, 32, 1, f);
+  fread(iv, 12, 1, f);
+  uint64_t seq = 0xfffffff0;
+
+  for (int i = 0; i < num_records; i++) {
+    lens[i] = (i*37) % 300;
+    if (i % 7 == 0) lens[i] += 5000;
+    plaintext[i] = malloc(lens[i] + 1);
+    sealed[i] = malloc(lens[i] + 16);
+    fread(plaintext[i], lens[i], 1, f);
+    records[i] = (struct tls_record){sealed[i], plaintext[i], lens[i], header, 5};
+  }
+  vector_tls13_seal_records(records, num_records, key, iv, seq);
+
+  bool pass = true;
+  for (int i = 0; i < num_records && pass; i++) {
+    uint8_t* golden = malloc(lens[i] + 16);
+    tls13_nonce(nonce, iv, seq + i);
+    vector_chacha20_poly1305_seal(golden, plaintext[i], lens[i], header, 5, nonce, key);
+    if (memcmp(golden, sealed[i], lens[i] + 16) != 0) {
+      printf("tls13 record %d of len %zu\n", i, lens[i]);
+      pass = false;
+    }
+    free(golden);
+  }
+
+  // Open in place, then again with record 45 forged.
+  for (int i = 0; i < num_records; i++) {
+    records[i] = (struct tls_record){sealed[i], sealed[i], lens[i] + 16, header, 5};
+  }
+  pass = pass && vector_tls13_open_records(records, num_records, key, iv, seq) == num_records;
+  for (int i = 0; i < num_records && pass; i++) {
+    pass = memcmp(plaintext[i], sealed[i], lens[i]) == 0;
+  }
+  for (int i = 0; i < num_records; i++) {
+    records[i] = (struct tls_record){sealed[i], plaintext[i], lens[i], header, 5};
+  }
+  vector_tls13_seal_records(records, num_records, key, iv, seq);
+  for (int i = 0; i < num_records; i++) {
+    records[i] = (struct tls_record){sealed[i], sealed[i], lens[i] + 16, header, 5};
+  }
+  sealed[45][0] ^= 1;
+  pass = pass && vector_tls13_open_records(records, num_records, key, iv, seq) == 45;
+
+  for (int i = 0; i < num_records; i++) {
+    free(plaintext[i]);
+    free(sealed[i]);
+  }
+  return pass;
+}
+
+// QUIC header protection masks against ChaCha20 of 5 zero bytes.
+bool test_quic_hp(FILE* f) {
+  // RFC 9001 appendix A.5
+  uint32_t sample_words[4];
+  uint8_t* sample = (uint8_t*)sample_words;
+  uint8_t key[32], golden[5], mask[5];
+  parse_hex(key, "25a282b9e82f06f21f488917a4fc8f1b73573685608597d0efcb076b0ab7a7a4", 32);
+  parse_hex(sample, "5e5cd55c41f69080575d7999c25a5bfb", 16);
+  parse_hex(golden, "aefefe7d03", 5);
+  vector_quic_hp_masks((uint8_t(*)[5])mask, (const uint8_t(*)[16])sample, 1, key);
+  bool pass = memcmp(golden, mask, 5) == 0;
+
+  const int num_packets = 1000;
+  uint32_t* samples = malloc(num_packets * 16);
+  uint8_t* masks = malloc(num_packets * 5 + 1);
+  const uint8_t zeros[5] = {0};
+  fread(key, 32, 1, f);
+  fread(samples, num_packets * 16, 1, f);
+  masks[num_packets * 5] = 0xa5;
+  vector_quic_hp_masks((uint8_t(*)[5])masks, (const uint8_t(*)[16])samples, num_packets, key);
+  for (int i = 0; i < num_packets && pass; i++) {
+    boring_chacha20(golden, zeros, 5, key, (uint8_t*)&samples[4*i + 1], samples[4*i]);
+    if (memcmp(golden, masks + 5*i, 5) != 0) {
+      printf("quic hp mask %d\n", i);
+      pass = false;
+    }
+  }
+  pass = pass && masks[num_packets * 5] == 0xa5;
+  free(samples);
+  free(masks);
+  return pass;
+}
+
+// chacha20-poly1305@openssh.com from BoringSSL's ChaCha20 and Poly1305.
+void boring_openssh_seal(uint8_t* out, const uint8_t* in, size_t len,
+			 uint32_t seqnr, const uint8_t key[64]) {
+  uint8_t nonce[12] = {0}, poly_key[32] = {0};
+  for (int i = 0; i < 4; i++) {
+    nonce[8+i] = seqnr >> (24 - 8*i);
+  }
+  boring_chacha20(poly_key, poly_key, 32, key, nonce, 0);
+  boring_chacha20(out, in, 4, key+32, nonce, 0);
+  boring_chacha20(out+4, in+4, len-4, key, nonce, 1);
+  poly1305_state state;
+  boring_poly1305_init(&state, poly_key);
+  boring_poly1305_update(&state, out, len);
+  boring_poly1305_finish(&state, out+len);
+}
+
+bool test_openssh(FILE* f) {
+  // Generated with libsodium's original ChaCha20 and Poly1305, the way
+  // OpenSSH's cipher-chachapoly-libcrypt.c uses them.
+  uint8_t key[64], packet[20], golden[36], sealed[36];
+  for (int i = 0; i < 64; i++) {
+    key[i] = i;
+  }
+  parse_hex(packet, "000000100a5e0102030405060708090a0b0c0d0e", 20);
+  parse_hex(golden, "fb1a929a8a1b1db9314ea1778f47f500b0eb9b4d"
+	    "b749e349292fbbe0c178734b11ffd85f", 36);
+  vector_openssh_chacha20_poly1305_seal(sealed, packet, 20, 3, key);
+  bool pass = memcmp(golden, sealed, 36) == 0;
+  pass = pass && vector_openssh_get_length(sealed, 3, key) == 16;
+  pass = pass && vector_openssh_chacha20_poly1305_open(sealed, sealed, 36, 3, key) == 0;
+  pass = pass && memcmp(packet, sealed, 20) == 0;
+
+  const int max_len = 5000;
+  uint8_t* data = malloc(max_len);
+  uint8_t* want = malloc(max_len + 16);
+  uint8_t* got = malloc(max_len + 16);
+  fread(data, max_len, 1, f);
+  fread(key, 64, 1, f);
+  uint32_t seqnr = 0xfffffff0;
+  for (int len = 4; len < max_len && pass; len += len < 300 ? 1 : 333) {
+    seqnr++;
+    boring_openssh_seal(want, data, len, seqnr, key);
+    vector_openssh_chacha20_poly1305_seal(got, data, len, seqnr, key);
+    if (memcmp(want, got, len + 16) != 0) {
+      printf("openssh seal len=%d\n", len);
+      pass = false;
+    }
+    // Opens in place, and a wrong sequence number or tag is rejected.
+    pass = pass && vector_openssh_chacha20_poly1305_open(got, got, len + 16, seqnr + 1, key) == -1;
+    want[len] ^= 1;
+    pass = pass && vector_openssh_chacha20_poly1305_open(got, want, len + 16, seqnr, key) == -1;
+    pass = pass && vector_openssh_chacha20_poly1305_open(got, got, len + 16, seqnr, key) == 0;
+    pass = pass && memcmp(data, got, len) == 0;
+  }
+
+  // Length keystreams for a run of packets, against one at a time.
+  const int num_packets = 300;
+  uint8_t (*keystreams)[4] = malloc(num_packets * 4);
+  vector_openssh_length_keystreams(keystreams, num_packets, seqnr, key);
+  for (int i = 0; i < num_packets && pass; i++) {
+    uint32_t length = 0;
+    for (int j = 0; j < 4; j++) {
+      length = (length << 8) | (data[4*i+j] ^ keystreams[i][j]);
+    }
+    pass = length == vector_openssh_get_length(data + 4*i, seqnr + i, key);
+  }
+  free(keystreams);
+  free(data);
+  free(want);
+  free(got);
+  return pass;
+}
+
+// Seals and opens under a key and nonce each, against one at a time, with
+// forgeries and opens too short for a tag mixed in.
+bool test_aead_batch(FILE* f) {
+  const int num_requests = 100;
+  struct aead_request requests[num_requests];
+  uint8_t keys[num_requests][32], nonces[num_requests][12], ad[13];
+  uint8_t* data[num_requests];
+  uint8_t* out[num_requests];
+  size_t lens[num_requests];
+  fread(ad, 13, 1, f);
+
+  for (int i = 0; i < num_requests; i++) {
+    fread(keys[i], 32, 1, f);
+    fread(nonces[i], 12, 1, f);
+    lens[i] = (i*37) % 300;
+    if (i % 11 == 0) lens[i] += 3000;
+    data[i] = malloc(lens[i] + 16);
+    out[i] = malloc(lens[i] + 16);
+    fread(data[i], lens[i], 1, f);
+    int open = i % 3 == 0;
+    if (open) {
+      // A ciphertext to open, forged for every fourth open.
+      vector_chacha20_poly1305_seal(data[i], data[i], lens[i], ad, i % 14,
+				    nonces[i], keys[i]);
+      if (i % 4 == 0) data[i][lens[i]] ^= 1;
+    }
+    size_t in_len = open ? lens[i] + 16 : lens[i];
+    if (i == 42) in_len = 15;
+    requests[i] = (struct aead_request){out[i], data[i], in_len, ad, i % 14,
+					nonces[i], keys[i], open, 1};
+  }
+  vector_chacha20_poly1305_batch(requests, num_requests);
+
+  bool pass = true;
+  for (int i = 0; i < num_requests && pass; i++) {
+    struct aead_request* r = &requests[i];
+    uint8_t* want = malloc(lens[i] + 16);
+    int result;
+    if (r->open) {
+      result = vector_chacha20_poly1305_open(want, r->in, r->in_len, ad, r->ad_len,
+					     nonces[i], keys[i]);
+    } else {
+      vector_chacha20_poly1305_seal(want, r->in, r->in_len, ad, r->ad_len,
+				    nonces[i], keys[i]);
+      result = 0;
+    }
+    size_t out_len = r->open ? lens[i] : lens[i] + 16;
+    if (r->result != result || (result == 0 && memcmp(want, out[i], out_len) != 0)) {
+      printf("aead batch request %d len=%zu open=%d\n", i, lens[i], r->open);
+      pass = false;
+    }
+    free(want);
+  }
+  for (int i = 0; i < num_requests; i++) {
+    free(data[i]);
+    free(out[i]);
+  }
+  return pass;
+}
+
+struct batcher_thread {
+  struct aead_batcher* batcher;
+  int id;
+  bool pass;
+};
+
+void batcher_done(struct aead_job* job) {
+  __atomic_fetch_add((int*)job->arg, 1, __ATOMIC_RELAXED);
+}
+
+// Seals from several threads, each waiting for one packet at a time, against
+// vector_chacha20_poly1305_seal.
+void* batcher_test_thread(void* arg) {
+  struct batcher_thread* t = arg;
+  uint8_t key[32], nonce[12], data[300], sealed[316], want[316];
+  memset(key, t->id, 32);
+  memset(nonce, 0, 12);
+  memset(data, 0x55, 300);
+  t->pass = true;
+  for (int i = 0; i < 50 && t->pass; i++) {
+    size_t len = (i*37 + t->id) % 300;
+    nonce[0] = i;
+    struct aead_job job;
+    memset(&job, 0, sizeof(job));
+    job.request = (struct aead_request){sealed, data, len, nonce, 12, nonce, key, 0, 0};
+    aead_batcher_submit(t->batcher, &job);
+    t->pass = aead_job_wait(t->batcher, &job) == 0;
+    vector_chacha20_poly1305_seal(want, data, len, nonce, 12, nonce, key);
+    t->pass = t->pass && memcmp(want, sealed, len + 16) == 0;
+  }
+  return NULL;
+}
+
+bool test_batcher() {
+  struct aead_batcher batcher;
+  // The deadline flushes what the threads can't fill.
+  if (aead_batcher_init(&batcher, 8, 50000) != 0) {
+    return false;
+  }
+  struct batcher_thread threads[5];
+  pthread_t ids[5];
+  for (int i = 0; i < 5; i++) {
+    threads[i] = (struct batcher_thread){&batcher, i, false};
+    pthread_create(&ids[i], NULL, batcher_test_thread, &threads[i]);
+  }
+  bool pass = true;
+  for (int i = 0; i < 5; i++) {
+    pthread_join(ids[i], NULL);
+    pass = pass && threads[i].pass;
+  }
+
+  // Callbacks, run by the flush.
+  uint8_t key[32], nonce[12], data[64], sealed[20][80];
+  memset(key, 0xaa, 32);
+  memset(nonce, 0xbb, 12);
+  memset(data, 0x55, 64);
+  struct aead_job jobs[20];
+  int done = 0;
+  for (int i = 0; i < 20; i++) {
+    memset(&jobs[i], 0, sizeof(jobs[i]));
+    jobs[i].request = (struct aead_request){sealed[i], data, 64, NULL, 0, nonce, key, 0, 0};
+    jobs[i].done = batcher_done;
+    jobs[i].arg = &done;
+    aead_batcher_submit(&batcher, &jobs[i]);
+  }
+  aead_batcher_flush(&batcher);
+  pass = pass && __atomic_load_n(&done, __ATOMIC_RELAXED) == 20;
+  aead_batcher_destroy(&batcher);
+  return pass;
+}
+
+// The ring against sealing each packet from scratch, with the ring
+// sometimes empty, partly filled, or too short for the packet.
+bool test_ring(FILE* f) {
+  struct chacha20_poly1305_ring ring;
+  uint8_t key[32], iv[12], nonce[12], ad[13];
+  uint8_t data[300], want[316], got[316];
+  fread(key, 32, 1, f);
+  fread(iv, 12, 1, f);
+  fread(ad, 13, 1, f);
+  fread(data, 300, 1, f);
+  uint64_t seq = 0xfffffffa;
+  if (vector_chacha20_poly1305_ring_init(&ring, 7, 100, key, iv, seq) != 0) {
+    return false;
+  }
+  bool pass = true;
+  for (int i = 0; i < 500 && pass; i++) {
+    uint8_t r[3];
+    fread(r, 3, 1, f);
+    if (r[0] % 3 == 0) {
+      vector_chacha20_poly1305_ring_fill(&ring, r[0] % 10);
+    }
+    size_t len = r[1] % (i % 5 == 0 ? 300 : 129);
+    size_t ad_len = r[2] % 14;
+    tls13_nonce(nonce, iv, seq + i);
+    vector_chacha20_poly1305_seal(want, data, len, ad, ad_len, nonce, key);
+    vector_chacha20_poly1305_ring_seal(&ring, got, data, len, ad, ad_len);
+    if (memcmp(want, got, len + 16) != 0) {
+      printf("ring packet %d len=%zu ready=%zu\n", i, len, ring.ready);
+      pass = false;
+    }
+  }
+  vector_chacha20_poly1305_ring_free(&ring);
+  return pass;
+}
+
+bool test_aeads(FILE* f) {
+  // RFC 8439 section 2.8.2
+  uint8_t key[32], nonce[12], ad[12], golden[130], sealed[130];
+  const char* plaintext = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+  for (int i = 0; i < 32; i++) {
+    key[i] = 0x80 + i;
+  }
+  parse_hex(nonce, "070000004041424344454647", 12);
+  parse_hex(ad, "50515253c0c1c2c3c4c5c6c7", 12);
+  parse_hex(golden, "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+	    "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+	    "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+	    "3ff4def08e4b7a9de576d26586cec64b61161ae10b594f09e26a7e902ecbd060"
+	    "0691", 130);
+  vector_chacha20_poly1305_seal(sealed, (const uint8_t*)plaintext, 114, ad, 12, nonce, key);
+  bool pass = memcmp(golden, sealed, 130) == 0;
+  if (!pass) {
+    printf("golden: ");
+    println_hex(golden, 130);
+    printf("vector: ");
+    println_hex(sealed, 130);
+  }
+
+  // Long enough for open_stream to take the fused path.
+  const int big_len = 200*1024 + 5;
+  uint8_t* data = malloc(big_len);
+  fread(data, big_len, 1, f);
+  pass = pass && test_aead(data, big_len, ad, 12, key, nonce);
+  pass = pass && test_aead_overlap(data, big_len, ad, 12, key, nonce);
+  pass = pass && test_aead_overlap(data, 1000, ad, 12, key, nonce);
+  pass = pass && test_tls13_records(f);
+  pass = pass && test_quic_hp(f);
+  pass = pass && test_openssh(f);
+  pass = pass && test_ring(f);
+  pass = pass && test_aead_batch(f);
+  pass = pass && test_batcher();
+
+  if (pass) {
+    for (int i = 1, len = 0; len < 1000; len += i++) {
+      size_t ad_len = len % 37;
+      fread(key, 32, 1, f);
+      fread(nonce, 12, 1, f);
+      if (!test_aead(data, len, data + 1000, ad_len, key, nonce)) {
+	printf("Failed with len=%d\n", len);
+	pass = false;
+	break;
+      }
+    }
+  }
+
+  if (pass) {
+    printf("VLEN=%d aead   %s\n", vlmax_u32()*32, pass_str);
+  } else {
+    printf("VLEN=%d aead   %s\n", vlmax_u32()*32, fail_str);
+  }
+  free(data);
+  return pass;
+}
+
+int open_cycle_counter() {
   struct perf_event_attr perf;
   memset(&perf, 0, sizeof(struct perf_event_attr));
   perf.type = PERF_TYPE_HARDWARE;
@@ -231,14 +1120,18 @@ void run_benchmarks(size_t input_size, size_t num_runs) {
     fprintf(stderr, "Error opening perf event: %s\n", strerror(errno));
     exit(EXIT_FAILURE);
   }
+  return fd;
+}
 
+void run_benchmarks(size_t input_size, size_t num_runs) {
+  int fd = open_cycle_counter();
   struct rusage time_stuff;
 
   double vector_state[24];
   poly1305_state boring_state;
   struct poly1305_context openssl_state;
-  uint8_t key[32], sig[16];
-  uint8_t* data = malloc(input_size);
+  uint8_t key[32], sig[16], digest[32];
+  uint8_t* data = buffer_alloc(input_size);
   memset(key, 0xaa, 32);
   memset(data, 0x55, input_size);
 
@@ -336,9 +1229,9 @@ void run_benchmarks(size_t input_size, size_t num_runs) {
   	(double)(cycles)/(input_size*num_runs));
 
 
-  // Benchmark vector blocks.
+  // Benchmark scalar blocks.
   // Warm up the instruction cache.
-  vector_poly1305(key, 32, key, sig, vector_poly1305_blocks);
+  vector_poly1305(key, 32, key, sig, vector_poly1305_scalar_blocks);
 
   getrusage(RUSAGE_SELF, &time_stuff);
   micros_start = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
@@ -346,7 +1239,63 @@ void run_benchmarks(size_t input_size, size_t num_runs) {
   ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
 
   for (int i = 0; i < num_runs; i++) {
-    vector_poly1305(data, input_size, key, sig, vector_poly1305_blocks);
+    vector_poly1305(data, input_size, key, sig, vector_poly1305_scalar_blocks);
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_end = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  micros = micros_end - micros_start;
+
+  if (read(fd, &cycles, sizeof(cycles)) == -1) {
+    fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  printf("poly scalar\t% 5ld bytes\t%.1f MB/s\t%.2f cycles/byte\n", input_size,
+  	(double)(input_size*num_runs)/micros,
+  	(double)(cycles)/(input_size*num_runs));
+
+
+  // Benchmark radix 2^44 blocks.
+  // Warm up the instruction cache.
+  vector_poly1305(key, 32, key, sig, vector_poly1305_blocks44);
+
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_start = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  for (int i = 0; i < num_runs; i++) {
+    vector_poly1305(data, input_size, key, sig, vector_poly1305_blocks44);
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_end = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  micros = micros_end - micros_start;
+
+  if (read(fd, &cycles, sizeof(cycles)) == -1) {
+    fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  printf("poly radix44\t% 5ld bytes\t%.1f MB/s\t%.2f cycles/byte\n", input_size,
+  	(double)(input_size*num_runs)/micros,
+  	(double)(cycles)/(input_size*num_runs));
+
+
+  // Benchmark vector blocks.
+  // Warm up the instruction cache.
+  vector_poly1305(key, 32, key, sig, vector_poly1305_blocks);
+
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_start = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  for (int i = 0; i < num_runs; i++) {
+    vector_poly1305(data, input_size, key, sig, vector_poly1305_blocks);
   }
 
   ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
@@ -362,23 +1311,930 @@ void run_benchmarks(size_t input_size, size_t num_runs) {
   printf("poly vector\t% 5ld bytes\t%.1f MB/s\t%.2f cycles/byte\n", input_size,
   	(double)(input_size*num_runs)/micros,
   	(double)(cycles)/(input_size*num_runs));
+
+  // Benchmark intrinsics.
+  // Warm up the instruction cache.
+  intrinsic_poly1305(key, 32, key, sig);
+
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_start = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  for (int i = 0; i < num_runs; i++) {
+    intrinsic_poly1305(data, input_size, key, sig);
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_end = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  micros = micros_end - micros_start;
+
+  if (read(fd, &cycles, sizeof(cycles)) == -1) {
+    fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  printf("poly intrinsics\t% 5ld bytes\t%.1f MB/s\t%.2f cycles/byte\n", input_size,
+  	(double)(input_size*num_runs)/micros,
+  	(double)(cycles)/(input_size*num_runs));
+
+  // Benchmark blake3.
+  // Warm up the instruction cache.
+  vector_blake3(digest, key, 32);
+
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_start = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  for (int i = 0; i < num_runs; i++) {
+    vector_blake3(digest, data, input_size);
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_end = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  micros = micros_end - micros_start;
+
+  if (read(fd, &cycles, sizeof(cycles)) == -1) {
+    fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  printf("blake3 vector\t% 5ld bytes\t%.1f MB/s\t%.2f cycles/byte\n", input_size,
+  	(double)(input_size*num_runs)/micros,
+  	(double)(cycles)/(input_size*num_runs));
+
+  // Benchmark keyed blake2sp.
+  // Warm up the instruction cache.
+  vector_blake2sp(digest, key, 32, key, 32);
+
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_start = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  for (int i = 0; i < num_runs; i++) {
+    vector_blake2sp(digest, data, input_size, key, 32);
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  getrusage(RUSAGE_SELF, &time_stuff);
+  micros_end = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+  micros = micros_end - micros_start;
+
+  if (read(fd, &cycles, sizeof(cycles)) == -1) {
+    fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  printf("blake2sp vector\t% 5ld bytes\t%.1f MB/s\t%.2f cycles/byte\n", input_size,
+  	(double)(input_size*num_runs)/micros,
+  	(double)(cycles)/(input_size*num_runs));
 } 
 
+// Benchmark vector poly at every block multiple up to max_size, to check that
+// lengths that don't fill the final vector cost the same per byte.
+void run_poly_sweep(size_t max_size) {
+  int fd = open_cycle_counter();
+  uint8_t key[32], sig[16];
+  uint8_t* data = buffer_alloc(max_size);
+  memset(key, 0xaa, 32);
+  memset(data, 0x55, max_size);
+
+  // Warm up the instruction cache.
+  vector_poly1305(key, 32, key, sig, vector_poly1305_blocks);
+
+  for (size_t input_size = 16; input_size <= max_size; input_size += 16) {
+    size_t num_runs = (10<<20)/(input_size+100);
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+    for (int i = 0; i < num_runs; i++) {
+      vector_poly1305(data, input_size, key, sig, vector_poly1305_blocks);
+    }
+
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t cycles;
+    if (read(fd, &cycles, sizeof(cycles)) == -1) {
+      fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    printf("poly sweep\t% 5ld bytes\t%.2f cycles/byte\n", input_size,
+    	(double)(cycles)/(input_size*num_runs));
+  }
+  buffer_free(data, max_size);
+}
+
+uint64_t time_chacha(int fd, uint8_t* data, size_t input_size, size_t num_slices,
+		     size_t stride, const uint8_t key[32], const uint8_t nonce[12],
+		     chacha_func chacha) {
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  for (size_t i = 0; i < num_slices; i++) {
+    uint8_t* slice = data + (i*stride);
+    chacha(slice, slice, input_size, key, nonce, 0);
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  uint64_t cycles;
+  if (read(fd, &cycles, sizeof(cycles)) == -1) {
+    fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return cycles;
+}
+
+uint64_t time_chacha_at(int fd, uint8_t* data, size_t input_size,
+			const uint64_t* offsets, size_t num_reads,
+			const uint8_t key[32], const uint8_t nonce[12]) {
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  for (size_t i = 0; i < num_reads; i++) {
+    uint8_t* range = data + offsets[i];
+    vector_chacha20_at(range, range, input_size, key, nonce, offsets[i]);
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  uint64_t cycles;
+  if (read(fd, &cycles, sizeof(cycles)) == -1) {
+    fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return cycles;
+}
+
+// Benchmark chacha in place over buffers of input_size bytes, both hot, by
+// encrypting the same buffer repeatedly, and cold, by walking through an arena
+// much larger than the last level cache so that no buffer is reused. Then
+// vector_chacha20_at over the arena in order and at random offsets.
+void run_chacha_cold(size_t input_size) {
+  int fd = open_cycle_counter();
+  uint8_t key[32], nonce[12];
+  memset(key, 0xaa, 32);
+  memset(nonce, 0xbb, 12);
+  input_size &= ~63;
+  size_t arena_size = 256<<20;
+  if (arena_size < 2*input_size) arena_size = 2*input_size;
+  size_t num_slices = arena_size / input_size;
+  uint8_t* data = buffer_alloc(arena_size);
+  memset(data, 0x55, arena_size);
+
+  for (int f = 0; f < num_chacha_impls; f++) {
+    // Warm up the instruction cache, and the buffer for the hot run.
+    time_chacha(fd, data, input_size, 1, 0, key, nonce, chacha_impls[f].func);
+    uint64_t hot = time_chacha(fd, data, input_size, num_slices, 0, key, nonce, chacha_impls[f].func);
+    uint64_t cold = time_chacha(fd, data, input_size, num_slices, input_size, key, nonce, chacha_impls[f].func);
+    printf("chacha %s\t% 9ld bytes\thot %.2f cycles/byte\tcold %.2f cycles/byte\n",
+	   chacha_impls[f].name, input_size,
+	   (double)(hot)/(input_size*num_slices),
+	   (double)(cold)/(input_size*num_slices));
+  }
+
+  // vector_chacha20_at on reads at random byte offsets, against the same
+  // number of reads front to back.
+  uint64_t* offsets = malloc(num_slices * sizeof(uint64_t));
+  uint64_t rand = 1;
+  for (size_t i = 0; i < num_slices; i++) {
+    offsets[i] = i*input_size;
+  }
+  uint64_t sequential = time_chacha_at(fd, data, input_size, offsets, num_slices, key, nonce);
+  for (size_t i = 0; i < num_slices; i++) {
+    rand = rand * 6364136223846793005 + 1442695040888963407;
+    offsets[i] = (rand >> 16) % (arena_size - input_size + 1);
+  }
+  uint64_t random = time_chacha_at(fd, data, input_size, offsets, num_slices, key, nonce);
+  printf("chacha at\t% 9ld bytes\tsequential %.2f cycles/byte\trandom %.2f cycles/byte\n",
+	 input_size, (double)(sequential)/(input_size*num_slices),
+	 (double)(random)/(input_size*num_slices));
+  free(offsets);
+  buffer_free(data, arena_size);
+}
+
+typedef int (*aead_open_func)(uint8_t *out, const uint8_t *in, size_t in_len,
+			      const uint8_t *ad, size_t ad_len,
+			      const uint8_t nonce[12], const uint8_t key[32]);
+
+uint64_t time_aead_open(int fd, const uint8_t* packets, uint8_t* out,
+			size_t packet_len, size_t num_packets,
+			const uint8_t key[32], const uint8_t nonce[12],
+			aead_open_func open) {
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  for (size_t i = 0; i < num_packets; i++) {
+    open(out, packets + i*(packet_len + 16), packet_len + 16, nonce, 12, nonce, key);
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  uint64_t cycles;
+  if (read(fd, &cycles, sizeof(cycles)) == -1) {
+    fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return cycles;
+}
+
+// Opens a batch of packets all valid, then with every other tag broken, as
+// under attack. seal is the cost of a full decrypt and MAC for comparison.
+void run_aead_benchmarks(size_t input_size) {
+  int fd = open_cycle_counter();
+  uint8_t key[32], nonce[12];
+  memset(key, 0xaa, 32);
+  memset(nonce, 0xbb, 12);
+  size_t num_packets = (16<<20) / (input_size + 16);
+  if (num_packets < 16) num_packets = 16;
+  size_t total = num_packets * input_size;
+  uint8_t* data = buffer_alloc(input_size);
+  uint8_t* out = buffer_alloc(input_size + 16);
+  uint8_t* packets = buffer_alloc(num_packets * (input_size + 16));
+  uint8_t* forged = buffer_alloc(num_packets * (input_size + 16));
+  memset(data, 0x55, input_size);
+
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  for (size_t i = 0; i < num_packets; i++) {
+    vector_chacha20_poly1305_seal(packets + i*(input_size + 16), data, input_size, nonce, 12, nonce, key);
+  }
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  uint64_t cycles;
+  if (read(fd, &cycles, sizeof(cycles)) == -1) {
+    fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  memcpy(forged, packets, num_packets * (input_size + 16));
+  for (size_t i = 0; i < num_packets; i += 2) {
+    forged[i*(input_size + 16) + input_size] ^= 1;
+  }
+  printf("aead seal\t\t% 9ld bytes\t%.2f cycles/byte\n", input_size,
+	 (double)(cycles)/total);
+
+  // Warm up the instruction cache.
+  time_aead_open(fd, packets, out, input_size, 1, key, nonce, vector_chacha20_poly1305_open);
+  cycles = time_aead_open(fd, packets, out, input_size, num_packets, key, nonce, vector_chacha20_poly1305_open);
+  printf("aead open valid\t\t% 9ld bytes\t%.2f cycles/byte\n", input_size,
+	 (double)(cycles)/total);
+  cycles = time_aead_open(fd, forged, out, input_size, num_packets, key, nonce, vector_chacha20_poly1305_open);
+  printf("aead open 50%% forged\t% 9ld bytes\t%.2f cycles/byte\n", input_size,
+	 (double)(cycles)/total);
+  cycles = time_aead_open(fd, forged, out, input_size, num_packets, key, nonce, vector_chacha20_poly1305_open_stream);
+  printf("aead stream 50%% forged\t% 9ld bytes\t%.2f cycles/byte\n", input_size,
+	 (double)(cycles)/total);
+
+
+  // Stripping a 13-byte header in front of each packet, by decrypting in
+  // place and then copying, and by decrypting over the header.
+  const size_t header_len = 13;
+  size_t framed_len = header_len + input_size + 16;
+  uint8_t* framed = buffer_alloc(num_packets * framed_len);
+  for (int shifted = 0; shifted < 2; shifted++) {
+    for (size_t i = 0; i < num_packets; i++) {
+      memcpy(framed + i*framed_len + header_len, packets + i*(input_size + 16), input_size + 16);
+    }
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    for (size_t i = 0; i < num_packets; i++) {
+      uint8_t* packet = framed + i*framed_len;
+      if (shifted) {
+	vector_chacha20_poly1305_open(packet, packet + header_len, input_size + 16, nonce, 12, nonce, key);
+      } else {
+	vector_chacha20_poly1305_open(packet + header_len, packet + header_len, input_size + 16, nonce, 12, nonce, key);
+	memmove(packet, packet + header_len, input_size);
+      }
+    }
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &cycles, sizeof(cycles)) == -1) {
+      fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    printf("aead open %s\t% 9ld bytes\t%.2f cycles/byte\n",
+	   shifted ? "over header" : "then copy", input_size,
+	   (double)(cycles)/total);
+  }
+
+  buffer_free(data, input_size);
+  buffer_free(out, input_size + 16);
+  buffer_free(packets, num_packets * (input_size + 16));
+  buffer_free(forged, num_packets * (input_size + 16));
+  buffer_free(framed, num_packets * framed_len);
+}
+
+// Records per second sealing a batch of TLS records of each size, one
+// record at a time and with the batch API.
+void run_tls_benchmarks() {
+  int fd = open_cycle_counter();
+  struct rusage time_stuff;
+  uint8_t key[32], iv[12], nonce[12];
+  uint8_t header[5] = {23, 3, 3, 0, 0};
+  memset(key, 0xaa, 32);
+  memset(iv, 0xbb, 12);
+  const size_t max_len = 16*1024;
+  const size_t num_records = 256;
+  uint8_t* data = buffer_alloc(max_len);
+  uint8_t* out = buffer_alloc(num_records * (max_len + 16));
+  struct tls_record records[num_records];
+  memset(data, 0x55, max_len);
+
+  for (size_t len = 16; len <= max_len; len *= 4) {
+    size_t runs = (64<<20) / (num_records * (len + 100)) + 1;
+    for (size_t i = 0; i < num_records; i++) {
+      records[i] = (struct tls_record){out + i*(len + 16), data, len, header, 5};
+    }
+    for (int batched = 0; batched < 2; batched++) {
+      // Warm up the instruction cache.
+      vector_tls13_seal_records(records, 1, key, iv, 0);
+      tls13_nonce(nonce, iv, 0);
+      vector_chacha20_poly1305_seal(out, data, len, header, 5, nonce, key);
+
+      getrusage(RUSAGE_SELF, &time_stuff);
+      uint64_t micros_start = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+      for (size_t run = 0; run < runs; run++) {
+	uint64_t seq = run * num_records;
+	if (batched) {
+	  vector_tls13_seal_records(records, num_records, key, iv, seq);
+	} else {
+	  for (size_t i = 0; i < num_records; i++) {
+	    tls13_nonce(nonce, iv, seq + i);
+	    vector_chacha20_poly1305_seal(records[i].out, data, len, header, 5, nonce, key);
+	  }
+	}
+      }
+
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      getrusage(RUSAGE_SELF, &time_stuff);
+      uint64_t micros_end = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+      uint64_t micros = micros_end - micros_start;
+      if (micros == 0) micros = 1;
+
+      uint64_t cycles;
+      if (read(fd, &cycles, sizeof(cycles)) == -1) {
+	fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+	exit(EXIT_FAILURE);
+      }
+
+      printf("tls13 seal %s\t% 6ld bytes\t%.0f records/s\t%.0f cycles/record\n",
+	     batched ? "batch" : "single", len,
+	     (double)(runs*num_records)*1000000/micros,
+	     (double)(cycles)/(runs*num_records));
+    }
+  }
+
+  // A burst of QUIC packets, one header protection mask each.
+  const size_t num_packets = 4096;
+  uint32_t* samples = buffer_alloc(num_packets * 16);
+  uint8_t* masks = buffer_alloc(num_packets * 5);
+  for (size_t i = 0; i < num_packets * 4; i++) {
+    samples[i] = i * 0x9e3779b9;
+  }
+  for (int batched = 0; batched < 2; batched++) {
+    getrusage(RUSAGE_SELF, &time_stuff);
+    uint64_t micros_start = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+    const size_t runs = 256;
+    for (size_t run = 0; run < runs; run++) {
+      if (batched) {
+	vector_quic_hp_masks((uint8_t(*)[5])masks, (const uint8_t(*)[16])samples, num_packets, key);
+      } else {
+	// A whole block per packet, since the kernel skips partial blocks.
+	for (size_t i = 0; i < num_packets; i++) {
+	  uint8_t block[64];
+	  memset(block, 0, 64);
+	  vector_chacha20(block, block, 64, key, (uint8_t*)&samples[4*i + 1], samples[4*i]);
+	  memcpy(masks + 5*i, block, 5);
+	}
+      }
+    }
+
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    getrusage(RUSAGE_SELF, &time_stuff);
+    uint64_t micros_end = (uint64_t)(time_stuff.ru_utime.tv_usec) + 1000000*(uint64_t)(time_stuff.ru_utime.tv_sec);
+    uint64_t micros = micros_end - micros_start;
+    if (micros == 0) micros = 1;
+
+    uint64_t cycles;
+    if (read(fd, &cycles, sizeof(cycles)) == -1) {
+      fprintf(stderr, "Error reading perf event: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    printf("quic hp mask %s\t%.0f packets/s\t%.0f cycles/packet\n",
+	   batched ? "batch" : "single",
+	   (double)(runs*num_packets)*1000000/micros,
+	   (double)(cycles)/(runs*num_packets));
+  }
+  buffer_free(samples, num_packets * 16);
+  buffer_free(masks, num_packets * 5);
+  buffer_free(data, max_len);
+  buffer_free(out, num_records * (max_len + 16));
+}
+
+uint64_t nanos() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+// Seal latency from the packet being available to the sealed packet, with
+// the ring refilled between packets as a flow would while idle.
+void run_latency_benchmarks() {
+  const size_t num_packets = 10000;
+  uint64_t* latencies = malloc(num_packets * sizeof(uint64_t));
+  uint8_t key[32], iv[12], nonce[12];
+  uint8_t header[5] = {23, 3, 3, 0, 0};
+  memset(key, 0xaa, 32);
+  memset(iv, 0xbb, 12);
+  uint8_t* data = malloc(4096);
+  uint8_t* out = malloc(4096 + 16);
+  memset(data, 0x55, 4096);
+
+  for (size_t len = 64; len <= 4096; len *= 4) {
+    struct chacha20_poly1305_ring ring;
+    if (vector_chacha20_poly1305_ring_init(&ring, 16, len, key, iv, 0) != 0) {
+      fprintf(stderr, "Error allocating ring\n");
+      exit(EXIT_FAILURE);
+    }
+    for (int precompute = 0; precompute < 2; precompute++) {
+      for (size_t i = 0; i < num_packets; i++) {
+	uint64_t start;
+	if (precompute) {
+	  vector_chacha20_poly1305_ring_fill(&ring, ring.num_slots);
+	  start = nanos();
+	  vector_chacha20_poly1305_ring_seal(&ring, out, data, len, header, 5);
+	} else {
+	  start = nanos();
+	  tls13_nonce(nonce, iv, i);
+	  vector_chacha20_poly1305_seal(out, data, len, header, 5, nonce, key);
+	}
+	latencies[i] = nanos() - start;
+      }
+      qsort(latencies, num_packets, sizeof(uint64_t), compare_u64);
+      printf("seal %s\t% 5ld bytes\tp50 %ld ns\tp99 %ld ns\n",
+	     precompute ? "precomputed" : "from scratch", len,
+	     latencies[num_packets / 2], latencies[num_packets * 99 / 100]);
+    }
+    vector_chacha20_poly1305_ring_free(&ring);
+  }
+  free(latencies);
+  free(data);
+  free(out);
+}
+
+// The batcher benchmark: each thread keeps BATCHER_DEPTH packets in flight,
+// waiting for the oldest before submitting the next, for throughput and the
+// latency from submission to completion at each deadline. Deadline 0 seals
+// directly without the batcher, for comparison.
+#define BATCHER_DEPTH 4
+
+struct batcher_bench_thread {
+  pthread_t thread;
+  struct aead_batcher* batcher;  // NULL to seal directly
+  size_t len;
+  size_t num_packets;
+  uint64_t* latencies;
+};
+
+void* batcher_bench_worker(void* arg) {
+  struct batcher_bench_thread* t = arg;
+  uint8_t key[32], nonce[12], header[5] = {23, 3, 3, 0, 0};
+  uint8_t* data = buffer_alloc(t->len);
+  uint8_t* out = buffer_alloc(BATCHER_DEPTH * (t->len + 16));
+  memset(key, 0xaa, 32);
+  memset(nonce, 0xbb, 12);
+  memset(data, 0x55, t->len);
+  if (t->batcher == NULL) {
+    for (size_t i = 0; i < t->num_packets; i++) {
+      uint64_t start = nanos();
+      vector_chacha20_poly1305_seal(out, data, t->len, header, 5, nonce, key);
+      t->latencies[i] = nanos() - start;
+    }
+  } else {
+    struct aead_job jobs[BATCHER_DEPTH];
+    memset(jobs, 0, sizeof(jobs));
+    for (size_t i = 0; i < t->num_packets + BATCHER_DEPTH; i++) {
+      struct aead_job* job = &jobs[i % BATCHER_DEPTH];
+      if (i >= BATCHER_DEPTH) {
+	aead_job_wait(t->batcher, job);
+	t->latencies[i - BATCHER_DEPTH] = nanos() - job->submitted_ns;
+      }
+      if (i < t->num_packets) {
+	uint8_t* packet_out = out + (i % BATCHER_DEPTH) * (t->len + 16);
+	job->request = (struct aead_request){packet_out, data, t->len, header, 5,
+					     nonce, key, 0, 0};
+	aead_batcher_submit(t->batcher, job);
+      }
+    }
+  }
+  buffer_free(data, t->len);
+  buffer_free(out, BATCHER_DEPTH * (t->len + 16));
+  return NULL;
+}
+
+void run_batcher_benchmarks(int num_threads) {
+  const size_t num_packets = 20000;
+  const uint64_t deadlines[] = {0, 2000, 10000, 50000, 250000};
+  struct batcher_bench_thread* threads = calloc(num_threads, sizeof(struct batcher_bench_thread));
+  uint64_t* latencies = malloc(num_threads * num_packets * sizeof(uint64_t));
+
+  for (size_t len = 64; len <= 1024; len *= 4) {
+    for (int d = 0; d < sizeof(deadlines)/sizeof(deadlines[0]); d++) {
+      struct aead_batcher batcher;
+      if (deadlines[d] > 0 && aead_batcher_init(&batcher, 32, deadlines[d]) != 0) {
+	fprintf(stderr, "Error starting batcher\n");
+	exit(EXIT_FAILURE);
+      }
+      uint64_t start = nanos();
+      for (int i = 0; i < num_threads; i++) {
+	threads[i] = (struct batcher_bench_thread){0, deadlines[d] ? &batcher : NULL,
+						   len, num_packets,
+						   latencies + i*num_packets};
+	if (pthread_create(&threads[i].thread, NULL, batcher_bench_worker, &threads[i]) != 0) {
+	  fprintf(stderr, "Error creating thread: %s\n", strerror(errno));
+	  exit(EXIT_FAILURE);
+	}
+      }
+      for (int i = 0; i < num_threads; i++) {
+	pthread_join(threads[i].thread, NULL);
+      }
+      uint64_t elapsed = nanos() - start;
+      double jobs_per_batch = 1;
+      if (deadlines[d] > 0) {
+	jobs_per_batch = (double)batcher.num_jobs / batcher.num_batches;
+	aead_batcher_destroy(&batcher);
+      }
+      size_t total = num_threads * num_packets;
+      qsort(latencies, total, sizeof(uint64_t), compare_u64);
+      printf("batcher % 5ld bytes\tdeadline % 7ld ns\t%.1f jobs/batch\t%.2f MB/s\tp50 %ld ns\tp99 %ld ns\n",
+	     len, deadlines[d], jobs_per_batch, (double)total * len * 1e3 / elapsed,
+	     latencies[total / 2], latencies[total * 99 / 100]);
+    }
+  }
+  free(latencies);
+  free(threads);
+}
+
+// The roofline benchmark: each thread streams through its own buffer, sized
+// to stay in L1, L2, the last level cache or DRAM, first with memcpy and a
+// read-only sum to measure the bandwidth roof at that level, then with each
+// kernel. ChaCha20 and the AEAD read and write every byte, so they are held
+// against memcpy, and Poly1305 only reads, so it is held against the sum.
+enum roof_kernel { ROOF_COPY, ROOF_READ, ROOF_CHACHA, ROOF_POLY, ROOF_AEAD };
+const char* roof_kernel_names[] = {"memcpy", "read", "chacha", "poly", "aead"};
+
+struct roof_thread {
+  pthread_t thread;
+  pthread_barrier_t* start;
+  enum roof_kernel kernel;
+  uint8_t* buf;
+  uint8_t* copy;  // memcpy's destination
+  size_t len;
+  size_t reps;
+  uint64_t begin, end;
+};
+
+void* roof_worker(void* arg) {
+  struct roof_thread* t = arg;
+  uint8_t key[32], nonce[12], sig[16];
+  memset(key, 0xaa, 32);
+  memset(nonce, 0xbb, 12);
+  volatile uint64_t sink = 0;
+  pthread_barrier_wait(t->start);
+  t->begin = nanos();
+  for (size_t i = 0; i < t->reps; i++) {
+    switch (t->kernel) {
+      case ROOF_COPY:
+	memcpy(t->copy, t->buf, t->len);
+	break;
+      case ROOF_READ: {
+	const uint64_t* words = (const uint64_t*)t->buf;
+	uint64_t sum = 0;
+	for (size_t j = 0; j < t->len / 8; j++) {
+	  sum += words[j];
+	}
+	sink += sum;
+	break;
+      }
+      case ROOF_CHACHA:
+	vector_chacha20(t->buf, t->buf, t->len, key, nonce, 0);
+	break;
+      case ROOF_POLY:
+	vector_poly1305(t->buf, t->len, key, sig, vector_poly1305_blocks);
+	break;
+      case ROOF_AEAD:
+	// Sealed in place, with the tag in the last 16 bytes.
+	vector_chacha20_poly1305_seal(t->buf, t->buf, t->len - 16, nonce, 12, nonce, key);
+	break;
+    }
+  }
+  t->end = nanos();
+  return NULL;
+}
+
+// Runs kernel on num_threads threads at once, and returns the aggregate
+// GB/s, with the slowest thread's GB/s in *per_thread.
+double time_roof(struct roof_thread* threads, int num_threads,
+		 enum roof_kernel kernel, double* per_thread) {
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    threads[i].start = &start;
+    threads[i].kernel = kernel;
+    if (pthread_create(&threads[i].thread, NULL, roof_worker, &threads[i]) != 0) {
+      fprintf(stderr, "Error creating thread: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+  uint64_t begin = UINT64_MAX, end = 0, slowest = 0;
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i].thread, NULL);
+    if (threads[i].begin < begin) begin = threads[i].begin;
+    if (threads[i].end > end) end = threads[i].end;
+    if (threads[i].end - threads[i].begin > slowest) {
+      slowest = threads[i].end - threads[i].begin;
+    }
+  }
+  pthread_barrier_destroy(&start);
+  double bytes = (double)threads[0].len * threads[0].reps;
+  *per_thread = bytes / slowest;
+  return bytes * num_threads / (end - begin);
+}
+
+size_t cache_size(int name, size_t fallback) {
+  long size = sysconf(name);
+  return size > 0 ? size : fallback;
+}
+
+// Rounded down to a power of two, to fill the arena's size classes.
+size_t floor_pow2(size_t len) {
+  size_t p = 64;
+  while (2*p <= len) p *= 2;
+  return p;
+}
+
+struct roof_level {
+  const char* name;
+  size_t len;
+  bool shared;  // split between the threads rather than one per thread
+};
+
+// Buffers are half a cache, so the copy's source and destination both fit,
+// and the DRAM level is well past the last level cache. sysconf doesn't know
+// the caches on every system, so those fall back to typical sizes.
+void roof_levels(struct roof_level levels[4]) {
+  size_t llc = cache_size(_SC_LEVEL3_CACHE_SIZE, 0);
+  if (llc == 0) llc = cache_size(_SC_LEVEL2_CACHE_SIZE, 4<<20);
+  levels[0] = (struct roof_level){"L1", floor_pow2(cache_size(_SC_LEVEL1_DCACHE_SIZE, 32<<10) / 2), false};
+  levels[1] = (struct roof_level){"L2", floor_pow2(cache_size(_SC_LEVEL2_CACHE_SIZE, 512<<10) / 2), false};
+  levels[2] = (struct roof_level){"LLC", floor_pow2(llc / 2), true};
+  levels[3] = (struct roof_level){"DRAM", floor_pow2(4*llc + (32<<20)), true};
+}
+
+// The length of the source and of the destination region that every level's
+// buffers are carved from.
+size_t roof_region_len(int max_threads) {
+  struct roof_level levels[4];
+  roof_levels(levels);
+  size_t len = 0;
+  for (int l = 0; l < 4; l++) {
+    size_t level_len = levels[l].shared ? levels[l].len : levels[l].len * max_threads;
+    if (level_len > len) len = level_len;
+  }
+  return len;
+}
+
+// Doubling thread counts, ending on max_threads when it isn't a power of
+// two, so the curve reaches every core of a 6 or 12 core machine.
+int next_thread_count(int num_threads, int max_threads) {
+  if (num_threads < max_threads && num_threads * 2 > max_threads) {
+    return max_threads;
+  }
+  return num_threads * 2;
+}
+
+// The private levels give every thread a buffer of their length, and the
+// shared levels split theirs between the threads, so that the threads
+// together stay in the last level cache or spill to DRAM however many there
+// are.
+void run_roofline(int max_threads) {
+  struct roof_level levels[4];
+  roof_levels(levels);
+  size_t region_len = roof_region_len(max_threads);
+  uint8_t* src = buffer_alloc(region_len);
+  uint8_t* dst = buffer_alloc(region_len);
+  memset(src, 0x55, region_len);
+  memset(dst, 0, region_len);
+  struct roof_thread* threads = calloc(max_threads, sizeof(struct roof_thread));
+
+  for (int l = 0; l < 4; l++) {
+    for (int num_threads = 1; num_threads <= max_threads;
+	 num_threads = next_thread_count(num_threads, max_threads)) {
+      size_t len = levels[l].len;
+      if (levels[l].shared) len = floor_pow2(len / num_threads);
+      for (int i = 0; i < num_threads; i++) {
+	threads[i].buf = src + i*len;
+	threads[i].copy = dst + i*len;
+	threads[i].len = len;
+	threads[i].reps = (64<<20) / len + 1;
+      }
+      double copy_roof = 0, read_roof = 0;
+      for (enum roof_kernel k = ROOF_COPY; k <= ROOF_AEAD; k++) {
+	double per_thread;
+	double total = time_roof(threads, num_threads, k, &per_thread);
+	if (k == ROOF_COPY) copy_roof = total;
+	if (k == ROOF_READ) read_roof = total;
+	double roof = k == ROOF_POLY || k == ROOF_READ ? read_roof : copy_roof;
+	printf("roofline %s\t%s % 10ld bytes/thread\t% 3d threads\t%.2f GB/s/thread\t%.2f GB/s\t%.0f%% of roof\n",
+	       roof_kernel_names[k], levels[l].name, len, num_threads,
+	       per_thread, total, 100 * total / roof);
+      }
+    }
+  }
+  free(threads);
+  buffer_free(src, region_len);
+  buffer_free(dst, region_len);
+}
+
+// Opening an n MiB encrypted file and reading pages at random through the
+// lazy map, a fault at a time and with full readahead, against decrypting
+// all of it up front. The lazy costs follow the pages read, not the file.
+void run_lazy_map_benchmarks(size_t mib) {
+  size_t len = mib << 20;
+  size_t num_pages = len / LAZY_MAP_PAGE;
+  uint8_t key[32], nonce[12];
+  memset(key, 0xaa, 32);
+  memset(nonce, 0xbb, 12);
+  FILE* file = tmpfile();
+  if (file == NULL || ftruncate(fileno(file), len) != 0) {
+    fprintf(stderr, "Error creating file: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  uint8_t* ciphertext = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+  if (ciphertext == MAP_FAILED) {
+    fprintf(stderr, "Error mapping file: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  memset(ciphertext, 0x55, len);
+  // Encrypting the file is the same pass as decrypting it eagerly.
+  uint64_t start = nanos();
+  vector_chacha20_at(ciphertext, ciphertext, len, key, nonce, 0);
+  uint64_t eager = nanos() - start;
+  uint8_t (*tags)[16] = malloc(num_pages * 16);
+  start = nanos();
+  lazy_map_tags(tags, ciphertext, len, key, nonce);
+  uint64_t eager_tags = eager + nanos() - start;
+  printf("lazy map eager\t%zu MiB\tdecrypt %.2f ms\twith tags %.2f ms\n",
+	 mib, eager * 1e-6, eager_tags * 1e-6);
+
+  const size_t readaheads[] = {1, LAZY_MAP_MAX_READAHEAD};
+  for (int t = 0; t < 2; t++) {
+    for (size_t r = 0; r < sizeof(readaheads)/sizeof(readaheads[0]); r++) {
+      for (size_t reads = 1; reads <= num_pages; reads *= 16) {
+	struct lazy_map map;
+	uint64_t start = nanos();
+	if (lazy_map_open(&map, fileno(file), len, key, nonce, t ? (const uint8_t(*)[16])tags : NULL, readaheads[r]) != 0) {
+	  fprintf(stderr, "Error opening lazy map: %s\n", strerror(errno));
+	  exit(EXIT_FAILURE);
+	}
+	uint64_t opened = nanos();
+	uint64_t rand = 1;
+	for (size_t i = 0; i < reads; i++) {
+	  rand = rand * 6364136223846793005 + 1442695040888963407;
+	  size_t page = (rand >> 16) % num_pages;
+	  (void)*(volatile const uint8_t*)(map.data + page * LAZY_MAP_PAGE);
+	}
+	uint64_t done = nanos();
+	size_t mapped = lazy_map_count(&map.pages_mapped);
+	lazy_map_close(&map);
+	printf("lazy map %s\t%zu MiB\treadahead %2zu\t%7zu reads\t%7zu pages\topen %.1f us\treads %.2f ms\t%.2f us/page\n",
+	       t ? "tags" : "plain", mib, readaheads[r], reads, mapped, (opened - start) * 1e-3,
+	       (done - opened) * 1e-6, (double)(done - opened) / mapped * 1e-3);
+      }
+    }
+  }
+  free(tags);
+  munmap(ciphertext, len);
+  fclose(file);
+}
+
+// How often the benchmarks took each kernel path, when built with
+// KERNEL_STATS.
+void print_kernel_stats() {
+  struct kernel_stats stats;
+  kernel_stats_snapshot(&stats);
+  uint64_t powers = stats.poly1305_cached_powers + stats.poly1305_computed_powers;
+  printf("poly1305 calls\tscalar %lu\tsingle %lu\tmulti %lu\tblocks44 %lu\n",
+	 stats.poly1305_scalar_blocks, stats.poly1305_single_blocks,
+	 stats.poly1305_multi_blocks, stats.poly1305_blocks44);
+  printf("poly1305 powers\tcached %lu\tcomputed %lu\t%.1f%% cached\n",
+	 stats.poly1305_cached_powers, stats.poly1305_computed_powers,
+	 powers ? 100.0 * stats.poly1305_cached_powers / powers : 0.0);
+  printf("chacha20 batches\t%lu\tshort %lu\t%.1f%% short\n",
+	 stats.chacha20_batches, stats.chacha20_short_batches,
+	 stats.chacha20_batches ?
+	 100.0 * stats.chacha20_short_batches / stats.chacha20_batches : 0.0);
+}
+
 int main(int argc, char *const argv[]) {
   bool benchmark = false;
-  int n = 1024;
+  bool sweep = false;
+  bool cold = false;
+  bool aead = false;
+  bool tls = false;
+  bool latency = false;
+  bool roofline = false;
+  bool batching = false;
+  bool lazy = false;
+  int n = 0;
   int c;
-  while ((c = getopt(argc, argv, "bn:")) != -1) {
+  while ((c = getopt(argc, argv, "abclmqrstun:")) != -1) {
     switch (c) {
+      case 'a':
+        aead = true;
+        break;
       case 'b':
         benchmark = true;
         break;
+      case 'c':
+        cold = true;
+        break;
+      case 'l':
+        latency = true;
+        break;
+      case 'm':
+        use_malloc = true;
+        break;
+      case 'q':
+        batching = true;
+        break;
+      case 'r':
+        tls = true;
+        break;
+      case 's':
+        sweep = true;
+        break;
+      case 't':
+        roofline = true;
+        break;
+      case 'u':
+        lazy = true;
+        break;
       case 'n':
         n = atoi(optarg);
         break;
     }
   }
-  if (benchmark) {
+  // Room for run_chacha_cold's max(256 MB, 2n) bytes of buffers on top of
+  // the rest. From 2 MB up a buffer only rounds up to a 2 MB page, not to a
+  // power of two.
+  size_t arena_size = (1<<30) + 4*(size_t)n;
+  if (roofline) {
+    if (n == 0) n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    // The source and destination.
+    arena_size += 2 * roof_region_len(n);
+  }
+  if (!use_malloc && arena_init(&buffers, arena_size) != 0) {
+    fprintf(stderr, "Error mapping buffer arena: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if (roofline) {
+    run_roofline(n);
+  } else if (lazy) {
+    if (n == 0) n = 64;
+    run_lazy_map_benchmarks(n);
+  } else if (batching) {
+    if (n == 0) n = 8;
+    run_batcher_benchmarks(n);
+  } else if (latency) {
+    run_latency_benchmarks();
+  } else if (tls) {
+    run_tls_benchmarks();
+  } else if (aead) {
+    if (n == 0) n = 1024;
+    run_aead_benchmarks(n);
+  } else if (cold) {
+    if (n == 0) n = 4<<20;
+    if (n < 64) n = 64;
+    run_chacha_cold(n);
+  } else if (sweep) {
+    if (n == 0) n = 1024;
+    if (n < 16) n = 16;
+    run_poly_sweep(n);
+  } else if (benchmark) {
+    if (n == 0) n = 1024;
     if (n < 1) n = 1;
     int runs = (100<<20)/(n+100);
     if (runs < 1) runs = 1;
@@ -387,7 +2243,13 @@ int main(int argc, char *const argv[]) {
     FILE* rand = fopen("/dev/urandom", "r");
     bool pass = test_chachas(rand);
     if (!test_polys(rand)) { pass = false; }
+    if (!test_salsas(rand)) { pass = false; }
+    if (!test_blakes(rand)) { pass = false; }
+    if (!test_aeads(rand)) { pass = false; }
     fclose(rand);
     return pass ? 0 : 1;
   }
+#ifdef KERNEL_STATS
+  print_kernel_stats();
+#endif
 }
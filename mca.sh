@@ -0,0 +1,124 @@
+#!/bin/sh
+
+# Copyright 2020 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License") ;
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Static throughput of the kernels' hot regions on the llvm-mca scheduling
+# models in $MODELS, for choosing between kernel variants without hardware to
+# time them on. Both default models need LLVM 18 or later.
+#
+# The regions are the ChaCha round loops and load/xor/store blocks, and the
+# Poly1305 vector, lazy, 44-bit, single block and scalar loops and the final
+# multiply by the powers of r. Each is cut out of the macro-expanded assembly
+# into mca/regions/<label>.s between llvm-mca markers, with the LMUL and SEW
+# of the last vsetvli before it, and runs from its label to its first branch,
+# or to the label after the colon. The full llvm-mca reports go in
+# mca/<model>/<label>.txt, and each gets a line of cycles per iteration, the
+# busiest resource and llvm-mca's bottleneck split.
+#
+# usage: ./mca.sh [grep pattern of labels]
+
+MODELS=${MODELS:-"sifive-x280 sifive-p670"}
+MARCH=${MARCH:-rv64gcv_zba_zbb_zvkb}
+MATTR=${MATTR:-+m,+a,+f,+d,+c,+v,+zba,+zbb,+zvkb}
+LLVM_MC=${LLVM_MC:-llvm-mc}
+LLVM_MCA=${LLVM_MCA:-llvm-mca}
+ITERATIONS=${ITERATIONS:-100}
+CHACHA_REGIONS="round_loop_* xor_blocks_*"
+POLY_REGIONS="vector_loop lazy_loop vector_loop44 single_block_loop
+    scalar_block_loop mul_powers_of_r:multi_blocks_return"
+
+# Writes each region of the expanded assembly on stdin to mca/regions.
+extract() {
+    awk -v regions="$1" '
+    function starts(label,    i, n, spec, parts) {
+        n = split(regions, spec, " ")
+        for (i = 1; i <= n; i++) {
+            split(spec[i], parts, ":")
+            if (parts[1] ~ /\*$/ ? index(label, substr(parts[1], 1, length(parts[1]) - 1)) == 1 : label == parts[1]) {
+                end_label = parts[2]
+                return 1
+            }
+        }
+        return 0
+    }
+    $1 ~ /^vset(i)?vli$/ {
+        for (i = 2; i <= NF; i++) {
+            f = $i
+            sub(/,$/, "", f)
+            if (f ~ /^e[0-9]+$/) sew = toupper(f)
+            if (f ~ /^mf?[1248]$/) lmul = toupper(f)
+        }
+    }
+    /^[A-Za-z_.][A-Za-z_.0-9]*:/ {
+        label = substr($1, 1, length($1) - 1)
+        if (file != "" && label == end_label) {
+            print "# LLVM-MCA-END" > file
+            close(file)
+            file = ""
+        }
+        if (file == "" && starts(label)) {
+            file = "mca/regions/" label ".s"
+            print "# LLVM-MCA-BEGIN " label > file
+            if (lmul != "") print "# LLVM-MCA-RISCV-LMUL " lmul > file
+            if (sew != "") print "# LLVM-MCA-RISCV-SEW " sew > file
+        }
+    }
+    file != "" && NF > 0 {
+        print > file
+        if (end_label == "" && $1 ~ /^(beqz?|bnez?|bltu?|bgeu?|blez|bgez|bltz|bgtz|bgtu?|bleu?|j|jr|ret)$/) {
+            print "# LLVM-MCA-END" > file
+            close(file)
+            file = ""
+        }
+    }'
+}
+
+rm -rf mca && mkdir -p mca/regions || exit 1
+clang -march=$MARCH -DVLS_KERNELS -E vchacha.S |
+    $LLVM_MC -triple=riscv64 -mattr=$MATTR -filetype=asm | extract "$CHACHA_REGIONS" &&
+    clang -march=$MARCH -E vpoly.S |
+    $LLVM_MC -triple=riscv64 -mattr=$MATTR -filetype=asm | extract "$POLY_REGIONS" || exit 1
+
+for MODEL in $MODELS; do
+    mkdir -p mca/$MODEL
+    for REGION in $(ls mca/regions | sed 's/\.s$//' | grep -e "${1:-.}"); do
+        REPORT=mca/$MODEL/$REGION.txt
+        if ! $LLVM_MCA -mtriple=riscv64 -mcpu=$MODEL -mattr=$MATTR \
+            -iterations=$ITERATIONS -bottleneck-analysis \
+            mca/regions/$REGION.s > $REPORT 2>&1; then
+            printf "%s\t%s\tfailed, see %s\n" $REGION $MODEL $REPORT
+            continue
+        fi
+        awk -v region=$REGION -v model=$MODEL '
+        /^Iterations:/ { iterations = $2 }
+        /^Total Cycles:/ { cycles = $3 }
+        /^Block RThroughput:/ { rthroughput = $3 }
+        /^ *Resource Pressure  / { resource = $4; sub(/%/, "", resource) }
+        /^ *Data Dependencies:/ { data = $4; sub(/%/, "", data) }
+        /^\[[0-9]+\] +- / { names[$1] = $3 }
+        /^Resource pressure per iteration:/ { getline header; getline values
+            n = split(header, h, " "); split(values, v, " ")
+            for (i = 1; i <= n; i++) {
+                if (v[i] != "-" && v[i] + 0 > busiest) { busiest = v[i] + 0; busiest_name = names[h[i]] }
+            }
+        }
+        END {
+            printf "%s\t%s\t%.2f cycles/iter\tRThroughput %s\tbusiest %s %.2f", region, model,
+                cycles / iterations, rthroughput, busiest_name, busiest
+            if (resource != "") printf "\tbottleneck resources %s%% data %s%%", resource, data
+            printf "\n"
+        }' $REPORT
+    done
+done
@@ -0,0 +1,718 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+// An OpenSSL 3 provider with the vector ChaCha20, ChaCha20-Poly1305 and
+// Poly1305, so anything using EVP can run them without changes. provider.sh
+// builds it and runs openssl speed against it.
+//
+// The Zvkb kernels are picked at load time if built with ZVKB_KERNELS, which
+// needs vchacha.S assembled with Zvkb. ChaCha20-Poly1305 has no TLS 1.2
+// record mode (OSSL_CIPHER_PARAM_AEAD_TLS1_AAD), and like the built in
+// provider, decryption is streamed and only fails at final.
+
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef void (*chacha_func)(uint8_t *out, const uint8_t *in, size_t in_len,
+			    const uint8_t key[32], const uint8_t nonce[12],
+			    uint32_t counter);
+
+extern void vector_chacha20(uint8_t *out, const uint8_t *in, size_t in_len,
+			    const uint8_t key[32], const uint8_t nonce[12],
+			    uint32_t counter);
+#ifdef ZVKB_KERNELS
+extern void vector_chacha20_zvkb(uint8_t *out, const uint8_t *in,
+				 size_t in_len, const uint8_t key[32],
+				 const uint8_t nonce[12], uint32_t counter);
+#endif
+
+extern void vector_poly1305_init(void *ctx, const unsigned char key[16]);
+extern void vector_poly1305_blocks(void *ctx, const unsigned char *inp,
+				   size_t len, uint32_t padbit);
+extern void vector_poly1305_emit(void *ctx, unsigned char mac[16],
+				 const uint8_t nonce[16]);
+
+static chacha_func chacha20 = vector_chacha20;
+
+// From the kernel's asm/hwprobe.h.
+struct riscv_hwprobe {
+  int64_t key;
+  uint64_t value;
+};
+#define RISCV_HWPROBE_KEY_IMA_EXT_0 4
+#define RISCV_HWPROBE_EXT_ZVKB (1ULL << 19)
+
+static void pick_kernels() {
+#if defined(ZVKB_KERNELS) && defined(__NR_riscv_hwprobe)
+  struct riscv_hwprobe probe = {RISCV_HWPROBE_KEY_IMA_EXT_0, 0};
+  if (syscall(__NR_riscv_hwprobe, &probe, 1, 0, NULL, 0) == 0 &&
+      (probe.value & RISCV_HWPROBE_EXT_ZVKB)) {
+    chacha20 = vector_chacha20_zvkb;
+  }
+#endif
+}
+
+// ChaCha20 over updates of any length, keeping the rest of a partly used
+// block's keystream.
+struct chacha_stream {
+  uint8_t key[32];
+  uint8_t nonce[12];
+  uint32_t counter;  // the next block
+  uint8_t keystream[64];
+  size_t used;  // bytes of keystream used, 64 when there is none
+};
+
+static void chacha_stream_init(struct chacha_stream *s, uint32_t counter) {
+  s->counter = counter;
+  s->used = 64;
+}
+
+// Like OpenSSL, a counter that wraps carries into the first nonce word.
+static void chacha_stream_advance(struct chacha_stream *s, size_t blocks) {
+  s->counter += blocks;
+  if (s->counter == 0) {
+    for (int i = 0; i < 4 && ++s->nonce[i] == 0; i++) {
+    }
+  }
+}
+
+static void chacha_stream_blocks(struct chacha_stream *s, uint8_t *out,
+				 const uint8_t *in, size_t blocks) {
+  while (blocks > 0) {
+    uint64_t until_wrap = (1ULL << 32) - s->counter;
+    size_t n = blocks < until_wrap ? blocks : until_wrap;
+    chacha20(out, in, n * 64, s->key, s->nonce, s->counter);
+    chacha_stream_advance(s, n);
+    out += n * 64;
+    in += n * 64;
+    blocks -= n;
+  }
+}
+
+static void chacha_stream_xor(struct chacha_stream *s, uint8_t *out,
+			      const uint8_t *in, size_t len) {
+  for (; len > 0 && s->used < 64; len--) {
+    *out++ = *in++ ^ s->keystream[s->used++];
+  }
+  size_t block_len = len & ~63;
+  chacha_stream_blocks(s, out, in, block_len / 64);
+  if (len > block_len) {
+    memset(s->keystream, 0, 64);
+    chacha_stream_blocks(s, s->keystream, s->keystream, 1);
+    s->used = 0;
+    for (size_t i = block_len; i < len; i++) {
+      out[i] = in[i] ^ s->keystream[s->used++];
+    }
+  }
+}
+
+// Poly1305 over updates of any length, buffering a partial block.
+struct poly1305_stream {
+  double state[24];  // openssl's scratch space
+  uint8_t s[16];
+  uint8_t buffer[16];
+  size_t used;
+};
+
+static void poly1305_stream_init(struct poly1305_stream *p,
+				 const uint8_t key[32]) {
+  vector_poly1305_init(&p->state, key);
+  memcpy(p->s, key + 16, 16);
+  p->used = 0;
+}
+
+static void poly1305_stream_update(struct poly1305_stream *p,
+				   const uint8_t *in, size_t len) {
+  if (p->used > 0) {
+    size_t n = 16 - p->used < len ? 16 - p->used : len;
+    memcpy(p->buffer + p->used, in, n);
+    p->used += n;
+    in += n;
+    len -= n;
+    if (p->used < 16) {
+      return;
+    }
+    vector_poly1305_blocks(&p->state, p->buffer, 16, 1);
+    p->used = 0;
+  }
+  size_t block_len = len & ~15;
+  vector_poly1305_blocks(&p->state, in, block_len, 1);
+  memcpy(p->buffer, in + block_len, len - block_len);
+  p->used = len - block_len;
+}
+
+// Zero pads to a whole block, as ChaCha20-Poly1305 does after the AD and
+// the ciphertext.
+static void poly1305_stream_pad(struct poly1305_stream *p) {
+  if (p->used > 0) {
+    memset(p->buffer + p->used, 0, 16 - p->used);
+    vector_poly1305_blocks(&p->state, p->buffer, 16, 1);
+    p->used = 0;
+  }
+}
+
+static void poly1305_stream_final(struct poly1305_stream *p,
+				  uint8_t mac[16]) {
+  if (p->used > 0) {
+    memset(p->buffer + p->used, 0, 16 - p->used);
+    p->buffer[p->used] = 1;
+    vector_poly1305_blocks(&p->state, p->buffer, 16, 0);
+  }
+  vector_poly1305_emit(&p->state, mac, p->s);
+}
+
+struct cipher_ctx {
+  struct chacha_stream stream;
+  struct poly1305_stream poly;
+  int aead;
+  int enc;
+  int key_set;
+  int nonce_set;
+  int in_data;  // past the AD
+  uint64_t ad_len;
+  uint64_t ct_len;
+  uint8_t tag[16];
+  size_t tag_len;
+};
+
+static void *cipher_newctx(void *provctx, int aead) {
+  struct cipher_ctx *ctx = calloc(1, sizeof(*ctx));
+  if (ctx != NULL) {
+    ctx->aead = aead;
+    ctx->tag_len = 16;
+  }
+  return ctx;
+}
+
+static void *chacha20_newctx(void *provctx) {
+  return cipher_newctx(provctx, 0);
+}
+
+static void *chacha20_poly1305_newctx(void *provctx) {
+  return cipher_newctx(provctx, 1);
+}
+
+static void cipher_freectx(void *vctx) {
+  struct cipher_ctx *ctx = vctx;
+  if (ctx != NULL) {
+    memset(ctx, 0, sizeof(*ctx));
+    free(ctx);
+  }
+}
+
+static void *cipher_dupctx(void *vctx) {
+  struct cipher_ctx *dup = malloc(sizeof(*dup));
+  if (dup != NULL) {
+    memcpy(dup, vctx, sizeof(*dup));
+  }
+  return dup;
+}
+
+// Once both key and nonce are in, block 0 is the Poly1305 key for
+// ChaCha20-Poly1305, and the data starts at block 1.
+static void cipher_start(struct cipher_ctx *ctx) {
+  if (!ctx->key_set || !ctx->nonce_set) {
+    return;
+  }
+  if (ctx->aead) {
+    uint8_t poly_key[64];
+    memset(poly_key, 0, 64);
+    chacha20(poly_key, poly_key, 64, ctx->stream.key, ctx->stream.nonce, 0);
+    poly1305_stream_init(&ctx->poly, poly_key);
+    memset(poly_key, 0, 64);
+    chacha_stream_init(&ctx->stream, 1);
+    ctx->in_data = 0;
+    ctx->ad_len = 0;
+    ctx->ct_len = 0;
+  }
+}
+
+static int cipher_set_ctx_params(void *vctx, const OSSL_PARAM params[]);
+
+static int cipher_init(struct cipher_ctx *ctx, int enc,
+		       const unsigned char *key, size_t key_len,
+		       const unsigned char *iv, size_t iv_len,
+		       const OSSL_PARAM params[]) {
+  ctx->enc = enc;
+  if (key != NULL) {
+    if (key_len != 32) {
+      return 0;
+    }
+    memcpy(ctx->stream.key, key, 32);
+    ctx->key_set = 1;
+  }
+  if (iv != NULL) {
+    if (ctx->aead) {
+      if (iv_len != 12) {
+	return 0;
+      }
+      memcpy(ctx->stream.nonce, iv, 12);
+    } else {
+      // EVP's ChaCha20 IV is the little endian counter, then the nonce.
+      if (iv_len != 16) {
+	return 0;
+      }
+      memcpy(ctx->stream.nonce, iv + 4, 12);
+      chacha_stream_init(&ctx->stream,
+			 iv[0] | iv[1] << 8 | iv[2] << 16 | (uint32_t)iv[3] << 24);
+    }
+    ctx->nonce_set = 1;
+  }
+  if (key != NULL || iv != NULL) {
+    cipher_start(ctx);
+  }
+  return cipher_set_ctx_params(ctx, params);
+}
+
+static int cipher_encrypt_init(void *vctx, const unsigned char *key,
+			       size_t key_len, const unsigned char *iv,
+			       size_t iv_len, const OSSL_PARAM params[]) {
+  return cipher_init(vctx, 1, key, key_len, iv, iv_len, params);
+}
+
+static int cipher_decrypt_init(void *vctx, const unsigned char *key,
+			       size_t key_len, const unsigned char *iv,
+			       size_t iv_len, const OSSL_PARAM params[]) {
+  return cipher_init(vctx, 0, key, key_len, iv, iv_len, params);
+}
+
+// For ChaCha20-Poly1305, out == NULL passes AD, as for the built in
+// ciphers.
+static int cipher_update(void *vctx, unsigned char *out, size_t *outl,
+			 size_t outsize, const unsigned char *in, size_t inl) {
+  struct cipher_ctx *ctx = vctx;
+  if (!ctx->key_set || !ctx->nonce_set) {
+    return 0;
+  }
+  if (ctx->aead && out == NULL) {
+    if (ctx->in_data) {
+      return 0;
+    }
+    poly1305_stream_update(&ctx->poly, in, inl);
+    ctx->ad_len += inl;
+    *outl = 0;
+    return 1;
+  }
+  if (outsize < inl) {
+    return 0;
+  }
+  if (ctx->aead) {
+    if (!ctx->in_data) {
+      poly1305_stream_pad(&ctx->poly);
+      ctx->in_data = 1;
+    }
+    // The MAC is over the ciphertext, which for decryption is in, and may be
+    // overwritten by out.
+    if (!ctx->enc) {
+      poly1305_stream_update(&ctx->poly, in, inl);
+    }
+    chacha_stream_xor(&ctx->stream, out, in, inl);
+    if (ctx->enc) {
+      poly1305_stream_update(&ctx->poly, out, inl);
+    }
+    ctx->ct_len += inl;
+  } else {
+    chacha_stream_xor(&ctx->stream, out, in, inl);
+  }
+  *outl = inl;
+  return 1;
+}
+
+// constant time compare
+static int tags_equal(const uint8_t *a, const uint8_t *b, size_t len) {
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; i++) {
+    diff |= a[i] ^ b[i];
+  }
+  return diff == 0;
+}
+
+static int cipher_final(void *vctx, unsigned char *out, size_t *outl,
+			size_t outsize) {
+  struct cipher_ctx *ctx = vctx;
+  *outl = 0;
+  if (!ctx->aead) {
+    return 1;
+  }
+  if (!ctx->key_set || !ctx->nonce_set) {
+    return 0;
+  }
+  uint8_t lengths[16], tag[16];
+  for (int i = 0; i < 8; i++) {
+    lengths[i] = ctx->ad_len >> (8 * i);
+    lengths[8 + i] = ctx->ct_len >> (8 * i);
+  }
+  poly1305_stream_pad(&ctx->poly);
+  poly1305_stream_update(&ctx->poly, lengths, 16);
+  poly1305_stream_final(&ctx->poly, tag);
+  // A nonce is good for one message.
+  ctx->nonce_set = 0;
+  if (ctx->enc) {
+    memcpy(ctx->tag, tag, 16);
+    return 1;
+  }
+  return tags_equal(tag, ctx->tag, ctx->tag_len);
+}
+
+static int cipher_cipher(void *vctx, unsigned char *out, size_t *outl,
+			 size_t outsize, const unsigned char *in, size_t inl) {
+  return cipher_update(vctx, out, outl, outsize, in, inl);
+}
+
+static int cipher_get_params(OSSL_PARAM params[], int aead) {
+  OSSL_PARAM *p;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_MODE)) != NULL &&
+      !OSSL_PARAM_set_uint(p, 0)) {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_KEYLEN)) != NULL &&
+      !OSSL_PARAM_set_size_t(p, 32)) {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IVLEN)) != NULL &&
+      !OSSL_PARAM_set_size_t(p, aead ? 12 : 16)) {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_BLOCK_SIZE)) != NULL &&
+      !OSSL_PARAM_set_size_t(p, 1)) {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD)) != NULL &&
+      !OSSL_PARAM_set_int(p, aead)) {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_CUSTOM_IV)) != NULL &&
+      !OSSL_PARAM_set_int(p, aead)) {
+    return 0;
+  }
+  return 1;
+}
+
+static int chacha20_get_params(OSSL_PARAM params[]) {
+  return cipher_get_params(params, 0);
+}
+
+static int chacha20_poly1305_get_params(OSSL_PARAM params[]) {
+  return cipher_get_params(params, 1);
+}
+
+static int cipher_get_ctx_params(void *vctx, OSSL_PARAM params[]) {
+  struct cipher_ctx *ctx = vctx;
+  OSSL_PARAM *p;
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_KEYLEN)) != NULL &&
+      !OSSL_PARAM_set_size_t(p, 32)) {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IVLEN)) != NULL &&
+      !OSSL_PARAM_set_size_t(p, ctx->aead ? 12 : 16)) {
+    return 0;
+  }
+  if (!ctx->aead) {
+    return 1;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD_TAGLEN)) != NULL &&
+      !OSSL_PARAM_set_size_t(p, ctx->tag_len)) {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD_TAG)) != NULL) {
+    if (!ctx->enc || p->data_size == 0 || p->data_size > 16 ||
+	!OSSL_PARAM_set_octet_string(p, ctx->tag, p->data_size)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int cipher_set_ctx_params(void *vctx, const OSSL_PARAM params[]) {
+  struct cipher_ctx *ctx = vctx;
+  const OSSL_PARAM *p;
+  size_t len;
+  if (params == NULL) {
+    return 1;
+  }
+  if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_KEYLEN)) != NULL &&
+      (!OSSL_PARAM_get_size_t(p, &len) || len != 32)) {
+    return 0;
+  }
+  if (!ctx->aead) {
+    return 1;
+  }
+  if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_IVLEN)) != NULL &&
+      (!OSSL_PARAM_get_size_t(p, &len) || len != 12)) {
+    return 0;
+  }
+  // A tag to check when decrypting, or just its length when encrypting.
+  if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_TAG)) != NULL) {
+    if (p->data_size == 0 || p->data_size > 16) {
+      return 0;
+    }
+    if (p->data != NULL) {
+      if (ctx->enc) {
+	return 0;
+      }
+      memcpy(ctx->tag, p->data, p->data_size);
+    }
+    ctx->tag_len = p->data_size;
+  }
+  return 1;
+}
+
+static const OSSL_PARAM *cipher_gettable_params(void *provctx) {
+  static const OSSL_PARAM params[] = {
+    OSSL_PARAM_uint(OSSL_CIPHER_PARAM_MODE, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_BLOCK_SIZE, NULL),
+    OSSL_PARAM_int(OSSL_CIPHER_PARAM_AEAD, NULL),
+    OSSL_PARAM_int(OSSL_CIPHER_PARAM_CUSTOM_IV, NULL),
+    OSSL_PARAM_END
+  };
+  return params;
+}
+
+static const OSSL_PARAM *cipher_gettable_ctx_params(void *vctx,
+						    void *provctx) {
+  static const OSSL_PARAM params[] = {
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_AEAD_TAGLEN, NULL),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG, NULL, 0),
+    OSSL_PARAM_END
+  };
+  return params;
+}
+
+static const OSSL_PARAM *cipher_settable_ctx_params(void *vctx,
+						    void *provctx) {
+  static const OSSL_PARAM params[] = {
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, NULL),
+    OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_AEAD_IVLEN, NULL),
+    OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG, NULL, 0),
+    OSSL_PARAM_END
+  };
+  return params;
+}
+
+#define CIPHER_FUNCTIONS(name)						\
+  static const OSSL_DISPATCH name##_functions[] = {			\
+    {OSSL_FUNC_CIPHER_NEWCTX, (void (*)(void))name##_newctx},		\
+    {OSSL_FUNC_CIPHER_FREECTX, (void (*)(void))cipher_freectx},	\
+    {OSSL_FUNC_CIPHER_DUPCTX, (void (*)(void))cipher_dupctx},		\
+    {OSSL_FUNC_CIPHER_ENCRYPT_INIT, (void (*)(void))cipher_encrypt_init}, \
+    {OSSL_FUNC_CIPHER_DECRYPT_INIT, (void (*)(void))cipher_decrypt_init}, \
+    {OSSL_FUNC_CIPHER_UPDATE, (void (*)(void))cipher_update},		\
+    {OSSL_FUNC_CIPHER_FINAL, (void (*)(void))cipher_final},		\
+    {OSSL_FUNC_CIPHER_CIPHER, (void (*)(void))cipher_cipher},		\
+    {OSSL_FUNC_CIPHER_GET_PARAMS, (void (*)(void))name##_get_params},	\
+    {OSSL_FUNC_CIPHER_GET_CTX_PARAMS, (void (*)(void))cipher_get_ctx_params}, \
+    {OSSL_FUNC_CIPHER_SET_CTX_PARAMS, (void (*)(void))cipher_set_ctx_params}, \
+    {OSSL_FUNC_CIPHER_GETTABLE_PARAMS, (void (*)(void))cipher_gettable_params}, \
+    {OSSL_FUNC_CIPHER_GETTABLE_CTX_PARAMS,				\
+     (void (*)(void))cipher_gettable_ctx_params},			\
+    {OSSL_FUNC_CIPHER_SETTABLE_CTX_PARAMS,				\
+     (void (*)(void))cipher_settable_ctx_params},			\
+    {0, NULL}								\
+  };
+
+CIPHER_FUNCTIONS(chacha20)
+CIPHER_FUNCTIONS(chacha20_poly1305)
+
+struct mac_ctx {
+  struct poly1305_stream poly;
+  int key_set;
+};
+
+static void *poly1305_newctx(void *provctx) {
+  return calloc(1, sizeof(struct mac_ctx));
+}
+
+static void poly1305_freectx(void *vctx) {
+  struct mac_ctx *ctx = vctx;
+  if (ctx != NULL) {
+    memset(ctx, 0, sizeof(*ctx));
+    free(ctx);
+  }
+}
+
+static void *poly1305_dupctx(void *vctx) {
+  struct mac_ctx *dup = malloc(sizeof(*dup));
+  if (dup != NULL) {
+    memcpy(dup, vctx, sizeof(*dup));
+  }
+  return dup;
+}
+
+static int poly1305_set_key(struct mac_ctx *ctx, const unsigned char *key,
+			    size_t key_len) {
+  if (key_len != 32) {
+    return 0;
+  }
+  poly1305_stream_init(&ctx->poly, key);
+  ctx->key_set = 1;
+  return 1;
+}
+
+static int poly1305_set_ctx_params(void *vctx, const OSSL_PARAM params[]) {
+  const OSSL_PARAM *p;
+  if (params != NULL &&
+      (p = OSSL_PARAM_locate_const(params, OSSL_MAC_PARAM_KEY)) != NULL) {
+    if (p->data_type != OSSL_PARAM_OCTET_STRING ||
+	!poly1305_set_key(vctx, p->data, p->data_size)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int poly1305_init(void *vctx, const unsigned char *key, size_t key_len,
+			 const OSSL_PARAM params[]) {
+  struct mac_ctx *ctx = vctx;
+  if (!poly1305_set_ctx_params(ctx, params)) {
+    return 0;
+  }
+  if (key != NULL) {
+    return poly1305_set_key(ctx, key, key_len);
+  }
+  // The key is one time, so reusing the context needs a new one.
+  return ctx->key_set;
+}
+
+static int poly1305_update(void *vctx, const unsigned char *data,
+			   size_t data_len) {
+  struct mac_ctx *ctx = vctx;
+  if (!ctx->key_set) {
+    return 0;
+  }
+  poly1305_stream_update(&ctx->poly, data, data_len);
+  return 1;
+}
+
+static int poly1305_final(void *vctx, unsigned char *out, size_t *outl,
+			  size_t outsize) {
+  struct mac_ctx *ctx = vctx;
+  if (!ctx->key_set || outsize < 16) {
+    return 0;
+  }
+  poly1305_stream_final(&ctx->poly, out);
+  ctx->key_set = 0;
+  *outl = 16;
+  return 1;
+}
+
+static int poly1305_get_params(OSSL_PARAM params[]) {
+  OSSL_PARAM *p = OSSL_PARAM_locate(params, OSSL_MAC_PARAM_SIZE);
+  return p == NULL || OSSL_PARAM_set_size_t(p, 16);
+}
+
+static const OSSL_PARAM *poly1305_gettable_params(void *provctx) {
+  static const OSSL_PARAM params[] = {
+    OSSL_PARAM_size_t(OSSL_MAC_PARAM_SIZE, NULL),
+    OSSL_PARAM_END
+  };
+  return params;
+}
+
+static const OSSL_PARAM *poly1305_settable_ctx_params(void *vctx,
+						      void *provctx) {
+  static const OSSL_PARAM params[] = {
+    OSSL_PARAM_octet_string(OSSL_MAC_PARAM_KEY, NULL, 0),
+    OSSL_PARAM_END
+  };
+  return params;
+}
+
+static const OSSL_DISPATCH poly1305_functions[] = {
+  {OSSL_FUNC_MAC_NEWCTX, (void (*)(void))poly1305_newctx},
+  {OSSL_FUNC_MAC_FREECTX, (void (*)(void))poly1305_freectx},
+  {OSSL_FUNC_MAC_DUPCTX, (void (*)(void))poly1305_dupctx},
+  {OSSL_FUNC_MAC_INIT, (void (*)(void))poly1305_init},
+  {OSSL_FUNC_MAC_UPDATE, (void (*)(void))poly1305_update},
+  {OSSL_FUNC_MAC_FINAL, (void (*)(void))poly1305_final},
+  {OSSL_FUNC_MAC_GET_PARAMS, (void (*)(void))poly1305_get_params},
+  {OSSL_FUNC_MAC_GETTABLE_PARAMS, (void (*)(void))poly1305_gettable_params},
+  {OSSL_FUNC_MAC_SET_CTX_PARAMS, (void (*)(void))poly1305_set_ctx_params},
+  {OSSL_FUNC_MAC_SETTABLE_CTX_PARAMS,
+   (void (*)(void))poly1305_settable_ctx_params},
+  {0, NULL}
+};
+
+static const OSSL_ALGORITHM vector_ciphers[] = {
+  {"ChaCha20", "provider=vector", chacha20_functions,
+   "ChaCha20 on the RISC-V vector extension"},
+  {"ChaCha20-Poly1305", "provider=vector", chacha20_poly1305_functions,
+   "ChaCha20-Poly1305 on the RISC-V vector extension"},
+  {NULL, NULL, NULL, NULL}
+};
+
+static const OSSL_ALGORITHM vector_macs[] = {
+  {"POLY1305", "provider=vector", poly1305_functions,
+   "Poly1305 on the RISC-V vector extension"},
+  {NULL, NULL, NULL, NULL}
+};
+
+static const OSSL_ALGORITHM *vector_query(void *provctx, int operation_id,
+					  int *no_cache) {
+  *no_cache = 0;
+  switch (operation_id) {
+    case OSSL_OP_CIPHER:
+      return vector_ciphers;
+    case OSSL_OP_MAC:
+      return vector_macs;
+  }
+  return NULL;
+}
+
+static const OSSL_PARAM *vector_gettable_params(void *provctx) {
+  static const OSSL_PARAM params[] = {
+    OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_NAME, NULL, 0),
+    OSSL_PARAM_int(OSSL_PROV_PARAM_STATUS, NULL),
+    OSSL_PARAM_END
+  };
+  return params;
+}
+
+static int vector_get_params(void *provctx, OSSL_PARAM params[]) {
+  OSSL_PARAM *p;
+  if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_NAME)) != NULL &&
+      !OSSL_PARAM_set_utf8_ptr(p, "RISC-V vector ChaCha20 and Poly1305")) {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_STATUS)) != NULL &&
+      !OSSL_PARAM_set_int(p, 1)) {
+    return 0;
+  }
+  return 1;
+}
+
+static const OSSL_DISPATCH vector_dispatch[] = {
+  {OSSL_FUNC_PROVIDER_QUERY_OPERATION, (void (*)(void))vector_query},
+  {OSSL_FUNC_PROVIDER_GETTABLE_PARAMS, (void (*)(void))vector_gettable_params},
+  {OSSL_FUNC_PROVIDER_GET_PARAMS, (void (*)(void))vector_get_params},
+  {0, NULL}
+};
+
+int OSSL_provider_init(const OSSL_CORE_HANDLE *handle,
+		       const OSSL_DISPATCH *in, const OSSL_DISPATCH **out,
+		       void **provctx) {
+  pick_kernels();
+  *out = vector_dispatch;
+  *provctx = (void *)handle;
+  return 1;
+}
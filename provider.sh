@@ -0,0 +1,48 @@
+#!/bin/sh
+
+# Copyright 2020 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License") ;
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Builds vector.so, the OpenSSL 3 provider in provider.c, and compares it with
+# the default provider in openssl speed. Needs a RISC-V sysroot with OpenSSL 3
+# built in it, in $SYSROOT.
+
+SYSROOT=${SYSROOT:-/usr/riscv64-linux-gnu}
+CPU=rv64,v=true,b=true,zvkb=true,rvv_ta_all_1s=on,rvv_ma_all_1s=on,rvv_vl_half_avl=on
+# Only the assembly gets Zvkb, and the provider picks it at load time.
+clang -march=rv64gcv_zvkb -fPIC -c vchacha.S -o vchacha.o &&
+    clang -march=rv64gcv -fPIC -c vpoly.S -o vpoly.o &&
+    clang -march=rv64gcv -fPIC -O2 -DZVKB_KERNELS --sysroot=$SYSROOT \
+        -c provider.c -o provider.o &&
+    clang -march=rv64gcv -shared -Wl,-Bsymbolic --sysroot=$SYSROOT \
+        provider.o vchacha.o vpoly.o -lcrypto -o vector.so || exit 1
+
+OPENSSL="qemu-riscv64 -L $SYSROOT -cpu $CPU,vlen=${VLEN:-256} $SYSROOT/bin/openssl"
+VECTOR="-provider-path . -provider vector -provider default -propquery provider=vector"
+# Check both providers agree before timing them.
+head -c 100000 /dev/urandom > provider_input
+KEY=$(head -c 32 /dev/urandom | od -An -tx1 | tr -d ' \n')
+IV=$(head -c 16 /dev/urandom | od -An -tx1 | tr -d ' \n')
+check() {
+    { $OPENSSL enc $1 -chacha20 -K $KEY -iv $IV -in provider_input &&
+        $OPENSSL mac $1 -macopt hexkey:$KEY -in provider_input POLY1305; } | cksum
+}
+[ "$(check)" = "$(check "$VECTOR")" ] || { echo "providers differ"; exit 1; }
+rm provider_input
+
+# openssl speed has no Poly1305 MAC before OpenSSL 3.2.
+for ALG in chacha20 chacha20-poly1305; do
+    $OPENSSL speed -evp $ALG $@ &&
+        $OPENSSL speed $VECTOR -evp $ALG $@ || exit 1
+done
@@ -0,0 +1,126 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "secretbox.h"
+
+#include <string.h>
+
+#ifdef __riscv_zvkb
+#define salsa20 vector_salsa20_zvkb
+#define hsalsa20 vector_hsalsa20_zvkb
+#else
+#define salsa20 vector_salsa20
+#define hsalsa20 vector_hsalsa20
+#endif
+
+extern void vector_poly1305_init(void *ctx, const unsigned char key[16]);
+extern void vector_poly1305_blocks(void *ctx, const unsigned char *inp,
+				   size_t len, uint32_t padbit);
+extern void vector_poly1305_emit(void *ctx, unsigned char mac[16],
+				 const uint8_t nonce[16]);
+
+static void poly1305(const uint8_t *in, size_t len, const uint8_t key[32],
+		     uint8_t mac[16]) {
+  double state[24];  // openssl's scratch space
+  vector_poly1305_init(&state, key);
+  size_t block_len = len & ~15;
+  vector_poly1305_blocks(&state, in, block_len, 1);
+  if (len > block_len) {
+    size_t tail_len = len & 15;
+    uint8_t buffer[16];
+    memset(buffer, 0, 16);
+    memcpy(buffer, in + block_len, tail_len);
+    buffer[tail_len] = 1;
+    vector_poly1305_blocks(&state, buffer, 16, 0);
+  }
+  vector_poly1305_emit(&state, mac, key + 16);
+}
+
+// Salsa20 of any length, finishing a partial block through a buffer.
+static void salsa20_xor(uint8_t *out, const uint8_t *in, size_t len,
+			const uint8_t key[32], const uint8_t nonce[8],
+			uint64_t counter) {
+  size_t block_len = len & ~63;
+  salsa20(out, in, block_len, key, nonce, counter);
+  if (len > block_len) {
+    uint8_t buffer[64];
+    memset(buffer, 0, 64);
+    memcpy(buffer, in + block_len, len - block_len);
+    salsa20(buffer, buffer, 64, key, nonce, counter + block_len / 64);
+    memcpy(out + block_len, buffer, len - block_len);
+  }
+}
+
+void vector_xsalsa20(uint8_t *out, const uint8_t *in, size_t in_len,
+		     const uint8_t key[32], const uint8_t nonce[24]) {
+  uint8_t subkey[32];
+  hsalsa20(subkey, key, nonce);
+  salsa20_xor(out, in, in_len, subkey, nonce + 16, 0);
+  memset(subkey, 0, 32);
+}
+
+// The first keystream block gives the Poly1305 key in its first 32 bytes,
+// and encrypts the first 32 bytes of the message with the rest.
+static void secretbox_first_block(uint8_t block[64], const uint8_t subkey[32],
+				  const uint8_t nonce[24]) {
+  memset(block, 0, 64);
+  salsa20(block, block, 64, subkey, nonce + 16, 0);
+}
+
+static void secretbox_xor(uint8_t *out, const uint8_t *in, size_t len,
+			  const uint8_t block[64], const uint8_t subkey[32],
+			  const uint8_t nonce[24]) {
+  size_t head_len = len < 32 ? len : 32;
+  for (size_t i = 0; i < head_len; i++) {
+    out[i] = in[i] ^ block[32 + i];
+  }
+  if (len > head_len) {
+    salsa20_xor(out + 32, in + 32, len - 32, subkey, nonce + 16, 1);
+  }
+}
+
+void vector_secretbox_easy(uint8_t *out, const uint8_t *in, size_t in_len,
+			   const uint8_t nonce[24], const uint8_t key[32]) {
+  uint8_t subkey[32], block[64];
+  hsalsa20(subkey, key, nonce);
+  secretbox_first_block(block, subkey, nonce);
+  secretbox_xor(out + 16, in, in_len, block, subkey, nonce);
+  poly1305(out + 16, in_len, block, out);
+  memset(subkey, 0, 32);
+  memset(block, 0, 64);
+}
+
+int vector_secretbox_open_easy(uint8_t *out, const uint8_t *in, size_t in_len,
+			       const uint8_t nonce[24], const uint8_t key[32]) {
+  if (in_len < 16) {
+    return -1;
+  }
+  uint8_t subkey[32], block[64], mac[16];
+  hsalsa20(subkey, key, nonce);
+  secretbox_first_block(block, subkey, nonce);
+  poly1305(in + 16, in_len - 16, block, mac);
+  // constant time compare
+  uint8_t diff = 0;
+  for (int i = 0; i < 16; i++) {
+    diff |= mac[i] ^ in[i];
+  }
+  int ret = -1;
+  if (diff == 0) {
+    secretbox_xor(out, in + 16, in_len - 16, block, subkey, nonce);
+    ret = 0;
+  }
+  memset(subkey, 0, 32);
+  memset(block, 0, 64);
+  return ret;
+}
@@ -0,0 +1,46 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Salsa20 over whole 64-byte blocks, from vchacha.S. Any partial block at the
+// end is ignored.
+void vector_salsa20(uint8_t *out, const uint8_t *in, size_t in_len,
+		    const uint8_t key[32], const uint8_t nonce[8],
+		    uint64_t counter);
+void vector_hsalsa20(uint8_t out[32], const uint8_t key[32],
+		     const uint8_t nonce[16]);
+#ifdef __riscv_zvkb
+void vector_salsa20_zvkb(uint8_t *out, const uint8_t *in, size_t in_len,
+			 const uint8_t key[32], const uint8_t nonce[8],
+			 uint64_t counter);
+void vector_hsalsa20_zvkb(uint8_t out[32], const uint8_t key[32],
+			  const uint8_t nonce[16]);
+#endif
+
+// XSalsa20 of any length.
+void vector_xsalsa20(uint8_t *out, const uint8_t *in, size_t in_len,
+		     const uint8_t key[32], const uint8_t nonce[24]);
+
+// NaCl crypto_secretbox (XSalsa20-Poly1305), in libsodium's "easy" layout:
+// out is the 16-byte tag followed by the in_len bytes of ciphertext.
+// out and in must not overlap.
+void vector_secretbox_easy(uint8_t *out, const uint8_t *in, size_t in_len,
+			   const uint8_t nonce[24], const uint8_t key[32]);
+
+// Checks the tag before decrypting anything. Returns 0 and writes
+// in_len - 16 bytes to out on success, and -1 without writing on failure.
+int vector_secretbox_open_easy(uint8_t *out, const uint8_t *in, size_t in_len,
+			       const uint8_t nonce[24], const uint8_t key[32]);
@@ -0,0 +1,48 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include "stats.h"
+
+#include <stddef.h>
+#include <string.h>
+
+_Static_assert(offsetof(struct kernel_stats, poly1305_scalar_blocks) ==
+	       STAT_POLY1305_SCALAR_BLOCKS, "stat offset");
+_Static_assert(offsetof(struct kernel_stats, poly1305_single_blocks) ==
+	       STAT_POLY1305_SINGLE_BLOCKS, "stat offset");
+_Static_assert(offsetof(struct kernel_stats, poly1305_multi_blocks) ==
+	       STAT_POLY1305_MULTI_BLOCKS, "stat offset");
+_Static_assert(offsetof(struct kernel_stats, poly1305_blocks44) ==
+	       STAT_POLY1305_BLOCKS44, "stat offset");
+_Static_assert(offsetof(struct kernel_stats, poly1305_cached_powers) ==
+	       STAT_POLY1305_CACHED_POWERS, "stat offset");
+_Static_assert(offsetof(struct kernel_stats, poly1305_computed_powers) ==
+	       STAT_POLY1305_COMPUTED_POWERS, "stat offset");
+_Static_assert(offsetof(struct kernel_stats, chacha20_batches) ==
+	       STAT_CHACHA20_BATCHES, "stat offset");
+_Static_assert(offsetof(struct kernel_stats, chacha20_short_batches) ==
+	       STAT_CHACHA20_SHORT_BATCHES, "stat offset");
+
+// Thread local, so counting doesn't bounce cache lines between threads.
+// vchacha.S and vpoly.S reach it through the initial exec model.
+__thread struct kernel_stats kernel_stats;
+
+void kernel_stats_snapshot(struct kernel_stats *stats) {
+  *stats = kernel_stats;
+}
+
+void kernel_stats_reset(void) {
+  memset(&kernel_stats, 0, sizeof(kernel_stats));
+}
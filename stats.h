@@ -0,0 +1,87 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+// Per-thread counters at the branch points of the assembly kernels, for
+// seeing which paths real traffic takes. They are only counted when
+// everything is built with -DKERNEL_STATS, and otherwise the kernels have
+// no extra instructions and the counters stay zero.
+// CFLAGS=-DKERNEL_STATS ./bench.sh prints them after the benchmarks.
+
+#define STAT_POLY1305_SCALAR_BLOCKS 0
+#define STAT_POLY1305_SINGLE_BLOCKS 8
+#define STAT_POLY1305_MULTI_BLOCKS 16
+#define STAT_POLY1305_BLOCKS44 24
+#define STAT_POLY1305_CACHED_POWERS 32
+#define STAT_POLY1305_COMPUTED_POWERS 40
+#define STAT_CHACHA20_BATCHES 48
+#define STAT_CHACHA20_SHORT_BATCHES 56
+
+#ifdef __ASSEMBLER__
+
+#ifdef KERNEL_STATS
+# Adds 1 to a counter, clobbering tmp0 and tmp1. Only the owning thread
+# writes its counters, so a plain load and store do, without an atomic.
+.macro stat_inc offset tmp0 tmp1
+	la.tls.ie \tmp1, kernel_stats
+	add \tmp1, \tmp1, tp
+	ld \tmp0, \offset(\tmp1)
+	addi \tmp0, \tmp0, 1
+	sd \tmp0, \offset(\tmp1)
+.endm
+
+# Counts a ChaCha20 batch of vl blocks, and whether it ran at less than
+# VLMAX = vlenb >> shift.
+.macro stat_batch vl shift tmp0 tmp1
+	stat_inc STAT_CHACHA20_BATCHES \tmp0 \tmp1
+	csrr \tmp0, vlenb
+	srli \tmp0, \tmp0, \shift
+	bgeu \vl, \tmp0, .Lstat_full_batch\@
+	stat_inc STAT_CHACHA20_SHORT_BATCHES \tmp0 \tmp1
+.Lstat_full_batch\@:
+.endm
+#else
+.macro stat_inc offset tmp0 tmp1
+.endm
+
+.macro stat_batch vl shift tmp0 tmp1
+.endm
+#endif
+
+#else
+
+#include <stdint.h>
+
+struct kernel_stats {
+  // vector_poly1305_blocks calls, by the kernel that ran them.
+  uint64_t poly1305_scalar_blocks;
+  uint64_t poly1305_single_blocks;
+  uint64_t poly1305_multi_blocks;
+  uint64_t poly1305_blocks44;
+  // multi_blocks calls that loaded the powers of r from the context, and
+  // those that had to compute them first.
+  uint64_t poly1305_cached_powers;
+  uint64_t poly1305_computed_powers;
+  // Passes through the ChaCha20 rounds of vector_chacha20 and its m2 variant,
+  // and those with fewer blocks than there are lanes.
+  uint64_t chacha20_batches;
+  uint64_t chacha20_short_batches;
+};
+
+// Copies the calling thread's counters.
+void kernel_stats_snapshot(struct kernel_stats *stats);
+// Zeroes the calling thread's counters.
+void kernel_stats_reset(void);
+
+#endif
@@ -19,7 +19,14 @@
 # I got qemu from my package manager.
 
 CPU=rv64,v=true,b=true,zvkb=true,rvv_ta_all_1s=on,rvv_ma_all_1s=on,rvv_vl_half_avl=on
-clang -march=rv64gcvb_zvkb main.c boring.c openssl.c vchacha.S vpoly.S -o main -O -static &&
-    qemu-riscv64 -cpu $CPU,vlen=128 main &&
-    qemu-riscv64 -cpu $CPU,vlen=256 main &&
-    qemu-riscv64 -cpu $CPU,vlen=512 main 
+SRCS="main.c boring.c openssl.c secretbox.c blake.c aead.c arena.c batcher.c intrinsics.c lazymap.c stats.c vchacha.S vpoly.S"
+clang -march=rv64gcvb_zvkb $SRCS -o main -O -static -pthread &&
+    clang -march=rv64gcvb_zvkb -DVLS_KERNELS $SRCS -o main_vls -O -static -pthread &&
+    clang -march=rv64gcvb_zvkb vcrypt.c aead.c arena.c vchacha.S vpoly.S -o vcrypt -O -static -pthread &&
+    clang -march=rv64gcvb_zvkb lazymap_test.c lazymap.c aead.c boring.c vchacha.S vpoly.S -o lazymap_test -O -static -pthread || exit 1
+for VLEN in 128 256 512 1024; do
+    qemu-riscv64 -cpu $CPU,vlen=$VLEN main &&
+        qemu-riscv64 -cpu $CPU,vlen=$VLEN main_vls &&
+        qemu-riscv64 -cpu $CPU,vlen=$VLEN lazymap_test &&
+        RUN="qemu-riscv64 -cpu $CPU,vlen=$VLEN" ./vcrypt_test.sh ./vcrypt || exit 1
+done
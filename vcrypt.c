@@ -0,0 +1,350 @@
+/* Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License") ;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+// File encryption with ChaCha20-Poly1305 in the STREAM construction of
+// Hoang, Reyhanitabar, Rogaway and Vizar, sealing chunks on worker threads
+// straight from the mmapped input to the mmapped output.
+//
+// The file is a header, then each chunk's ciphertext and tag. The header is
+// the magic, the big endian chunk length and a random 7-byte nonce prefix,
+// and is the AD of every chunk. Chunk i's nonce is the prefix, big endian i,
+// and a byte that is 1 for the last chunk, so chunks can't be reordered,
+// dropped or truncated. An empty file is one empty chunk, and a file has at
+// most 2^32 chunks.
+//
+// usage: vcrypt [-d] [-t threads] [-c chunk_kib] key_file in_file out_file
+//        vcrypt -b [-n mib]
+// key_file holds the 32-byte key. -b times sealing n MiB in memory across
+// thread counts and chunk lengths instead.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "aead.h"
+#include "arena.h"
+
+#define HEADER_LEN 20
+#define MAX_THREADS 256
+static const uint8_t magic[8] = "vcrypt01";
+
+struct job {
+  const uint8_t *in;
+  uint8_t *out;
+  size_t in_len;  // plaintext length when sealing, ciphertext when opening
+  size_t chunk_len;
+  size_t num_chunks;
+  const uint8_t *key;
+  const uint8_t *header;
+  int open;
+  size_t next_chunk;
+  int failed;
+};
+
+static void stream_nonce(uint8_t nonce[12], const uint8_t header[HEADER_LEN],
+			 uint32_t counter, int last) {
+  memcpy(nonce, header + 12, 7);
+  for (int i = 0; i < 4; i++) {
+    nonce[7 + i] = counter >> (24 - 8 * i);
+  }
+  nonce[11] = last;
+}
+
+// Workers take the next chunk until there are none, so a slow chunk or
+// thread doesn't hold up the others.
+static void *worker(void *arg) {
+  struct job *job = arg;
+  size_t sealed_len = job->chunk_len + 16;
+  for (;;) {
+    size_t i = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+    if (i >= job->num_chunks) {
+      return NULL;
+    }
+    int last = i == job->num_chunks - 1;
+    uint8_t nonce[12];
+    stream_nonce(nonce, job->header, i, last);
+    if (job->open) {
+      size_t len = last ? job->in_len - i * sealed_len : sealed_len;
+      if (vector_chacha20_poly1305_open(job->out + i * job->chunk_len,
+					job->in + i * sealed_len, len,
+					job->header, HEADER_LEN, nonce,
+					job->key) != 0) {
+	__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+	return NULL;
+      }
+    } else {
+      size_t len = last ? job->in_len - i * job->chunk_len : job->chunk_len;
+      vector_chacha20_poly1305_seal(job->out + i * sealed_len,
+				    job->in + i * job->chunk_len, len,
+				    job->header, HEADER_LEN, nonce, job->key);
+    }
+  }
+}
+
+// Returns 0, or -1 if any chunk failed to open.
+static int run_job(struct job *job, int num_threads) {
+  pthread_t threads[MAX_THREADS];
+  job->next_chunk = 0;
+  job->failed = 0;
+  for (int i = 1; i < num_threads; i++) {
+    if (pthread_create(&threads[i], NULL, worker, job) != 0) {
+      fprintf(stderr, "Error creating thread: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+  worker(job);
+  for (int i = 1; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  return job->failed ? -1 : 0;
+}
+
+static size_t num_chunks(size_t len, size_t chunk_len) {
+  return len == 0 ? 1 : (len + chunk_len - 1) / chunk_len;
+}
+
+static void make_header(uint8_t header[HEADER_LEN], uint32_t chunk_len) {
+  memcpy(header, magic, 8);
+  for (int i = 0; i < 4; i++) {
+    header[8 + i] = chunk_len >> (24 - 8 * i);
+  }
+  if (getrandom(header + 12, 7, 0) != 7) {
+    fprintf(stderr, "Error getting random bytes: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  header[19] = 0;
+}
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void *map_file(int fd, size_t len, int prot) {
+  if (len == 0) {
+    return NULL;
+  }
+  void *p = mmap(NULL, len, prot, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "Error mapping file: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+static int crypt_file(const char *key_path, const char *in_path,
+		      const char *out_path, int open_file, size_t chunk_len,
+		      int num_threads) {
+  uint8_t key[32];
+  FILE *key_file = fopen(key_path, "r");
+  if (key_file == NULL || fread(key, 32, 1, key_file) != 1) {
+    fprintf(stderr, "Error reading a 32-byte key from %s\n", key_path);
+    return 1;
+  }
+  fclose(key_file);
+
+  int in_fd = open(in_path, O_RDONLY);
+  struct stat st;
+  if (in_fd == -1 || fstat(in_fd, &st) == -1) {
+    fprintf(stderr, "Error opening %s: %s\n", in_path, strerror(errno));
+    return 1;
+  }
+  size_t file_len = st.st_size;
+  const uint8_t *file = map_file(in_fd, file_len, PROT_READ);
+
+  uint8_t header[HEADER_LEN];
+  struct job job;
+  size_t out_len;
+  job.key = key;
+  job.header = header;
+  job.open = open_file;
+  if (open_file) {
+    if (file_len < HEADER_LEN + 16 || memcmp(file, magic, 8) != 0) {
+      fprintf(stderr, "%s is not a vcrypt file\n", in_path);
+      return 1;
+    }
+    memcpy(header, file, HEADER_LEN);
+    chunk_len = 0;
+    for (int i = 0; i < 4; i++) {
+      chunk_len = chunk_len << 8 | header[8 + i];
+    }
+    if (chunk_len == 0) {
+      fprintf(stderr, "%s is not a vcrypt file\n", in_path);
+      return 1;
+    }
+    job.in = file + HEADER_LEN;
+    job.in_len = file_len - HEADER_LEN;
+    job.num_chunks = (job.in_len + chunk_len + 15) / (chunk_len + 16);
+    if (job.in_len - (job.num_chunks - 1) * (chunk_len + 16) < 16) {
+      fprintf(stderr, "%s is truncated\n", in_path);
+      return 1;
+    }
+    out_len = job.in_len - 16 * job.num_chunks;
+  } else {
+    make_header(header, chunk_len);
+    job.in = file;
+    job.in_len = file_len;
+    job.num_chunks = num_chunks(file_len, chunk_len);
+    out_len = HEADER_LEN + file_len + 16 * job.num_chunks;
+  }
+  job.chunk_len = chunk_len;
+  // Chunk indices are 32 bits of the nonce, so past 2^32 chunks nonces would
+  // repeat and reuse keystream.
+  if ((uint64_t)job.num_chunks > (uint64_t)1 << 32) {
+    fprintf(stderr, "%s has more than 2^32 chunks of %zu bytes\n", in_path,
+	    chunk_len);
+    return 1;
+  }
+
+  // The output is sized up front, so every chunk goes straight to its place
+  // in the mapping.
+  int out_fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (out_fd == -1 || ftruncate(out_fd, out_len) == -1) {
+    fprintf(stderr, "Error creating %s: %s\n", out_path, strerror(errno));
+    return 1;
+  }
+  uint8_t *out = map_file(out_fd, out_len, PROT_READ | PROT_WRITE);
+  if (open_file) {
+    job.out = out;
+  } else {
+    memcpy(out, header, HEADER_LEN);
+    job.out = out + HEADER_LEN;
+  }
+
+  double start = now();
+  int failed = run_job(&job, num_threads);
+  double seconds = now() - start;
+  memset(key, 0, 32);
+  if (out != NULL) {
+    munmap(out, out_len);
+  }
+  if (file != NULL) {
+    munmap((void *)file, file_len);
+  }
+  close(out_fd);
+  close(in_fd);
+  if (failed) {
+    unlink(out_path);
+    fprintf(stderr, "%s failed authentication\n", in_path);
+    return 1;
+  }
+  size_t len = open_file ? out_len : file_len;
+  fprintf(stderr, "%s %zu bytes in %zu chunks on %d threads: %.2f GB/s\n",
+	  open_file ? "opened" : "sealed", len, job.num_chunks, num_threads,
+	  len / seconds * 1e-9);
+  return 0;
+}
+
+// Doubling thread counts, ending on max_threads when it isn't a power of
+// two, as in main.c's roofline.
+static int next_thread_count(int num_threads, int max_threads) {
+  if (num_threads < max_threads && num_threads * 2 > max_threads) {
+    return max_threads;
+  }
+  return num_threads * 2;
+}
+
+// Sealing throughput in memory, for each thread count and chunk length,
+// with the speedup over one thread.
+static void run_benchmark(size_t len, int max_threads) {
+  uint8_t key[32], header[HEADER_LEN];
+  memset(key, 0xaa, 32);
+  make_header(header, 0);
+  size_t out_len = len + len / 1024 + 16;
+  // On huge pages, so the chunks' strided loads don't miss in the TLB.
+  struct arena *arena = malloc(sizeof(struct arena));
+  if (arena_init(arena, len + out_len + (4 << 20)) != 0) {
+    fprintf(stderr, "Error mapping buffers: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  uint8_t *in = arena_alloc(arena, len);
+  uint8_t *out = arena_alloc(arena, out_len);
+  if (in == NULL || out == NULL) {
+    fprintf(stderr, "Error allocating %zu bytes of buffers\n", len + out_len);
+    exit(EXIT_FAILURE);
+  }
+  memset(in, 0x55, len);
+  memset(out, 0, out_len);
+
+  for (size_t chunk_len = 16 << 10; chunk_len <= 1 << 20; chunk_len *= 4) {
+    struct job job = {.in = in, .out = out, .in_len = len,
+		      .chunk_len = chunk_len,
+		      .num_chunks = num_chunks(len, chunk_len), .key = key,
+		      .header = header, .open = 0};
+    double one_thread = 0;
+    for (int num_threads = 1; num_threads <= max_threads;
+	 num_threads = next_thread_count(num_threads, max_threads)) {
+      double start = now();
+      run_job(&job, num_threads);
+      double gbps = len / (now() - start) * 1e-9;
+      if (num_threads == 1) {
+	one_thread = gbps;
+      }
+      printf("vcrypt seal\t%8zu chunk\t%4d threads\t%.3f GB/s\t%.2fx\n",
+	     chunk_len, num_threads, gbps, gbps / one_thread);
+    }
+  }
+  arena_destroy(arena);
+  free(arena);
+}
+
+int main(int argc, char *const argv[]) {
+  int open_file = 0;
+  int benchmark = 0;
+  size_t chunk_len = 64 << 10;
+  size_t bench_len = 256 << 20;
+  int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int c;
+  while ((c = getopt(argc, argv, "bc:dn:t:")) != -1) {
+    switch (c) {
+      case 'b':
+        benchmark = 1;
+        break;
+      case 'c':
+        chunk_len = (size_t)atoi(optarg) << 10;
+        break;
+      case 'd':
+        open_file = 1;
+        break;
+      case 'n':
+        bench_len = (size_t)atoi(optarg) << 20;
+        break;
+      case 't':
+        num_threads = atoi(optarg);
+        break;
+    }
+  }
+  if (num_threads < 1) num_threads = 1;
+  if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+  if (benchmark) {
+    run_benchmark(bench_len, num_threads);
+    return 0;
+  }
+  if (argc - optind != 3 || chunk_len == 0 || chunk_len > 1 << 30) {
+    fprintf(stderr, "usage: vcrypt [-d] [-t threads] [-c chunk_kib] key_file in_file out_file\n"
+	    "       vcrypt -b [-n mib] [-t max_threads]\n");
+    return 1;
+  }
+  return crypt_file(argv[optind], argv[optind + 1], argv[optind + 2],
+		    open_file, chunk_len, num_threads);
+}
@@ -0,0 +1,22 @@
+#!/bin/sh
+
+# Copyright 2020 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License") ;
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Builds vcrypt and times sealing across thread counts and chunk lengths on
+# the machine it runs on, like bench.sh.
+
+clang -march=rv64gcvb $CFLAGS vcrypt.c aead.c arena.c vchacha.S vpoly.S -o vcrypt -O2 -static -pthread || exit 1
+
+./vcrypt -b $@
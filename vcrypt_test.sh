@@ -0,0 +1,119 @@
+#!/bin/sh
+
+# Copyright 2020 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License") ;
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Tests the vcrypt file format: seal then open round trips, and tampered
+# files that open must reject without leaving an output file behind.
+#
+# usage: [RUN="qemu-riscv64 -cpu ..."] vcrypt_test.sh path/to/vcrypt
+# RUN is put in front of every vcrypt command, to run a cross build.
+
+VCRYPT=$1
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+FAILED=0
+
+fail() {
+    echo "vcrypt: $*"
+    FAILED=1
+}
+
+vcrypt() {
+    $RUN "$VCRYPT" "$@" 2>/dev/null
+}
+
+# Flips the low bit of the byte at offset $2 of file $1.
+flip() {
+    byte=$(od -An -tu1 -j"$2" -N1 "$1")
+    printf "$(printf '\\%03o' $((byte ^ 1)))" |
+        dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+}
+
+# Opening $1 must fail and leave no output.
+reject() {
+    rm -f "$DIR/out"
+    if vcrypt -d "$DIR/key" "$1" "$DIR/out"; then
+        fail "$2 opened"
+    elif [ -e "$DIR/out" ]; then
+        fail "$2 left its output"
+    fi
+}
+
+head -c 32 /dev/urandom > "$DIR/key"
+
+for KIB in 1 4; do
+    CHUNK=$((KIB * 1024))
+    for LEN in 0 1000 $((2 * CHUNK)) $((3 * CHUNK + 123)); do
+        head -c $LEN /dev/urandom > "$DIR/in"
+        for THREADS in 1 3; do
+            if ! vcrypt -c $KIB -t $THREADS "$DIR/key" "$DIR/in" "$DIR/sealed" ||
+                    ! vcrypt -d -t $THREADS "$DIR/key" "$DIR/sealed" "$DIR/out" ||
+                    ! cmp -s "$DIR/in" "$DIR/out"; then
+                fail "round trip of $LEN bytes in $KIB KiB chunks on $THREADS threads"
+            fi
+        done
+    done
+
+    # Four chunks, the last one ragged, sealed twice under different nonces.
+    head -c $((3 * CHUNK + 123)) /dev/urandom > "$DIR/in"
+    vcrypt -c $KIB "$DIR/key" "$DIR/in" "$DIR/sealed" || fail "seal"
+    vcrypt -c $KIB "$DIR/key" "$DIR/in" "$DIR/other" || fail "seal"
+    SIZE=$(wc -c < "$DIR/sealed")
+    SEALED_CHUNK=$((CHUNK + 16))
+
+    cp "$DIR/sealed" "$DIR/bad"
+    flip "$DIR/bad" $((20 + SEALED_CHUNK + 100))
+    reject "$DIR/bad" "a flipped ciphertext bit"
+
+    cp "$DIR/sealed" "$DIR/bad"
+    flip "$DIR/bad" $((SIZE - 1))
+    reject "$DIR/bad" "a flipped tag bit"
+
+    head -c $((SIZE - 50)) "$DIR/sealed" > "$DIR/bad"
+    reject "$DIR/bad" "a truncated last chunk"
+
+    head -c $((20 + 3 * SEALED_CHUNK)) "$DIR/sealed" > "$DIR/bad"
+    reject "$DIR/bad" "a file without its last chunk"
+
+    head -c $((20 + SEALED_CHUNK)) "$DIR/sealed" > "$DIR/bad"
+    tail -c +$((20 + 2 * SEALED_CHUNK + 1)) "$DIR/sealed" >> "$DIR/bad"
+    reject "$DIR/bad" "a dropped chunk"
+
+    head -c 20 "$DIR/other" > "$DIR/bad"
+    tail -c +21 "$DIR/sealed" >> "$DIR/bad"
+    reject "$DIR/bad" "a swapped header"
+done
+
+# More than 2^32 chunks, which would repeat nonces, are refused both ways.
+# The files are sparse.
+TIB=$((1024 * 1024 * 1024 * 1024))
+truncate -s $((4 * TIB + 1)) "$DIR/huge" || exit 1
+rm -f "$DIR/out"
+if vcrypt -c 1 "$DIR/key" "$DIR/huge" "$DIR/out"; then
+    fail "sealing more than 2^32 chunks"
+elif [ -e "$DIR/out" ]; then
+    fail "sealing more than 2^32 chunks left its output"
+fi
+printf 'vcrypt01\000\000\004\000' > "$DIR/huge"
+truncate -s $((20 + 4 * TIB / 1024 * 1040 + 17)) "$DIR/huge"
+reject "$DIR/huge" "a file of more than 2^32 chunks"
+rm -f "$DIR/huge"
+
+if [ $FAILED = 0 ]; then
+    printf "vcrypt \033[32mPASS\033[0m\n"
+else
+    printf "vcrypt \033[31mFAIL\033[0m\n"
+fi
+exit $FAILED